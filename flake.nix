@@ -23,6 +23,7 @@
             pkgs.llvmPackages_19.clang
             pkgs.xorg.xrandr
             pkgs.xorg.libX11
+            pkgs.shaderc
           ];
           buildInputs = [
             pkgs.pkg-config
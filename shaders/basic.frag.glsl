@@ -1,4 +1,7 @@
 #version 460 core
+#ifdef BINDLESS_MATERIALS
+#extension GL_ARB_bindless_texture : require
+#endif
 
 layout(location = 0)
 out vec4 o_color;
@@ -7,21 +10,59 @@ layout(location = 0) in vec3 in_normal;
 layout(location = 1) in vec3 in_frag_pos;
 layout(location = 2) in vec2 in_uv;
 layout(location = 3) in mat3 in_TBN;
+layout(location = 6) flat in uint in_material_index;
 
+layout(std140, binding = 3) uniform PassUBO {
+    vec3 u_camera_pos;
+};
+
+#ifdef BINDLESS_MATERIALS
+// Compiled at runtime for the indirect path, the material of the draw is looked up in the
+// material table and the textures are bindless handles.
+const uint env_map_mip_count = ENV_MAP_MIP_COUNT;
+
+struct Material {
+    vec4 base_color_factor;
+    vec4 metallic_roughness_normal_occlusion;
+    vec3 emissive_factor;
+    uint flags;
+    uvec2 textures[5];
+};
+
+layout(std430, binding = 5) readonly buffer MaterialTable {
+    Material materials[];
+};
+
+#define u_base_color_factor materials[in_material_index].base_color_factor
+#define u_metallic_roughness_normal_occlusion materials[in_material_index].metallic_roughness_normal_occlusion
+#define u_material_flags materials[in_material_index].flags
+#define u_emissive_factor materials[in_material_index].emissive_factor
+#define s_texture sampler2D(materials[in_material_index].textures[0])
+#define s_metallic_roughness sampler2D(materials[in_material_index].textures[1])
+#define s_normal_map sampler2D(materials[in_material_index].textures[2])
+#define s_occlusion_map sampler2D(materials[in_material_index].textures[3])
+#define s_emission_map sampler2D(materials[in_material_index].textures[4])
+#else
 layout(constant_id = 0) const uint env_map_mip_count = 0;
 
-layout(std140, binding = 1) uniform MaterialUBO {
-    vec4 u_base_color_factor;
-    vec4 u_metallic_roughness_normal_occlusion;
-    vec3 u_camera_pos;
-    uint u_material_flags;
-    vec3 u_emissive_factor;
+// The parameters of every material of the scene, uploaded once. The textures of the material
+// are bound to units 0 to 4.
+struct MaterialParameters {
+    vec4 base_color_factor;
+    vec4 metallic_roughness_normal_occlusion;
+    vec3 emissive_factor;
+    uint flags;
 };
 
-layout(std140, binding = 2) uniform LightPosUBO {
-    vec3 light_positions[5];
+layout(std430, binding = 6) readonly buffer MaterialParameterTable {
+    MaterialParameters material_parameters[];
 };
 
+#define u_base_color_factor material_parameters[in_material_index].base_color_factor
+#define u_metallic_roughness_normal_occlusion material_parameters[in_material_index].metallic_roughness_normal_occlusion
+#define u_material_flags material_parameters[in_material_index].flags
+#define u_emissive_factor material_parameters[in_material_index].emissive_factor
+
 layout(binding = 0)
 uniform sampler2D s_texture;
 
@@ -36,6 +77,11 @@ uniform sampler2D s_occlusion_map;
 
 layout(binding = 4)
 uniform sampler2D s_emission_map;
+#endif
+
+layout(std140, binding = 2) uniform LightPosUBO {
+    vec3 light_positions[5];
+};
 
 layout(binding = 5)
 uniform sampler2D s_brdf_lut;
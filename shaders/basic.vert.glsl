@@ -1,23 +1,48 @@
 #version 460 core
 
+// PackedVertex, see Scene.h.
+// Octahedral encoded.
 layout(location = 0)
-in vec4 a_tangent;
+in vec2 a_tangent;
 
+// Position relative to the AABB of the primitive, w is the sign of the bitangent.
 layout(location = 1)
-in vec3 a_pos;
+in vec4 a_pos;
 
+// Octahedral encoded.
 layout(location = 2)
-in vec3 a_normal;
+in vec2 a_normal;
 
 layout(location = 3)
 in vec2 a_uv;
 
+// model is unused, the model matrices come from the instance buffer.
 layout (std140, binding = 0) uniform UBOMatrices {
-    mat4 model;
+    mat4 unused_model;
     mat4 view;
     mat4 projection;
 };
 
+layout (std430, binding = 3) readonly buffer InstanceTransforms {
+    mat4 instance_models[];
+};
+
+// Material and primitive index of every instanced draw, stored at the base instance of the draw.
+layout (std430, binding = 4) readonly buffer InstanceDraws {
+    uvec2 instance_draws[];
+};
+
+struct PrimitiveBounds {
+    vec4 aabb_min;
+    vec4 aabb_extent;
+};
+
+layout (std430, binding = 7) readonly buffer PrimitiveDequantization {
+    PrimitiveBounds primitive_bounds[];
+};
+
+layout (location = 6) flat out uint in_material_index;
+
 layout (location = 0) out vec3 in_normal;
 layout (location = 1) out vec3 in_frag_pos;
 layout (location = 2) out vec2 in_uv;
@@ -27,17 +52,35 @@ out gl_PerVertex {
     vec4 gl_Position;
 };
 
+vec3 octahedral_decode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -t : t;
+    v.y += v.y >= 0.0 ? -t : t;
+    return normalize(v);
+}
+
 void main() {
-    gl_Position = projection * view * model * vec4(a_pos, 1.0);
+    // gl_InstanceID does not include the base instance passed to the draw.
+    mat4 model = instance_models[gl_BaseInstance + gl_InstanceID];
+    uvec2 draw = instance_draws[gl_BaseInstance];
+    in_material_index = draw.x;
+
+    PrimitiveBounds bounds = primitive_bounds[draw.y];
+    vec3 pos = bounds.aabb_min.xyz + a_pos.xyz * bounds.aabb_extent.xyz;
+    vec3 normal = octahedral_decode(a_normal);
+    vec4 tangent = vec4(octahedral_decode(a_tangent), a_pos.w > 0.5 ? 1.0 : -1.0);
+
+    gl_Position = projection * view * model * vec4(pos, 1.0);
     in_uv = a_uv;
-    in_frag_pos = vec3(model * vec4(a_pos, 1.0));
+    in_frag_pos = vec3(model * vec4(pos, 1.0));
 
     mat3 normal_matrix = transpose(inverse(mat3(model)));
-    in_normal = normal_matrix * a_normal;
+    in_normal = normal_matrix * normal;
 
-    vec3 T = normalize(vec3(model * vec4(a_tangent.xyz, 0.0)));
+    vec3 T = normalize(vec3(model * vec4(tangent.xyz, 0.0)));
     vec3 N = normalize(in_normal);
     T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(a_normal, T) * a_tangent.w;
+    vec3 B = cross(normal, T) * tangent.w;
     in_TBN = mat3(T, B, N);
 }
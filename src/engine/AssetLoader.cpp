@@ -1,9 +1,23 @@
 #include "AssetLoader.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ASSET_LOADER_MMAP 1
+#endif
+
+#include "ecs/jobpool.hpp"
 #include "engine/scene/AssetManifest.h"
 #include "scene/Scene.h"
+#include "utils/compression.h"
 #include "utils/logging.h"
 
 namespace engine::loader {
@@ -24,26 +38,239 @@ static std::span<T> read_asset_data(u8*& ptr, u32 count, u8* end_of_file_Ptr) {
     return ret;
 }
 
-AssetFileData load_asset_file(const char* path) {
+struct SectionContents {
+    bool present = false;
+    AssetSection info;
+    // The bytes in the file and the array they hold, the same for uncompressed sections.
+    std::span<u8> stored;
+    std::span<u8> bytes;
+    // Where the chunks of a compressed section start in stored, followed by its end.
+    std::vector<u64> chunk_offsets;
+};
+
+// Checks the directory against the file and the sizes of the arrays in the header, and finds the
+// chunks of the compressed sections. Sections that are not in the directory must be empty.
+static bool parse_sections(std::span<u8> file, std::span<const AssetSection> directory,
+                           std::span<const u64> expected_sizes,
+                           std::span<SectionContents> sections) {
+    for (const auto& info : directory) {
+        if ((u32)info.type >= (u32)SectionType::count) {
+            ERROR("Unknown section type {} in the asset file", (u32)info.type);
+            return false;
+        }
+        const char* name = section_type_name(info.type);
+        SectionContents& section = sections[(u32)info.type];
+        if (section.present) {
+            ERROR("The asset file has two {} sections", name);
+            return false;
+        }
+        if (info.offset % section_alignment != 0 || info.offset > file.size() ||
+            info.size > file.size() - info.offset) {
+            ERROR("The {} section is not inside of the asset file", name);
+            return false;
+        }
+        if (info.uncompressed_size != expected_sizes[(u32)info.type]) {
+            ERROR("The {} section is {} bytes but the header says {}", name,
+                  info.uncompressed_size, expected_sizes[(u32)info.type]);
+            return false;
+        }
+        section.present = true;
+        section.info = info;
+        section.stored = file.subspan(info.offset, info.size);
+
+        if (info.compression == SectionCompression::none) {
+            if (info.size != info.uncompressed_size) {
+                ERROR("The uncompressed {} section has a compressed size", name);
+                return false;
+            }
+            section.bytes = section.stored;
+            continue;
+        }
+        if (info.compression != SectionCompression::lz4 || info.chunk_size == 0) {
+            ERROR("The {} section uses an unknown compression", name);
+            return false;
+        }
+
+        u64 num_chunks = (info.uncompressed_size + info.chunk_size - 1) / info.chunk_size;
+        if (num_chunks > info.size / sizeof(u32)) {
+            ERROR("The chunk table of the {} section is truncated", name);
+            return false;
+        }
+        u64 offset = num_chunks * sizeof(u32);
+        section.chunk_offsets.push_back(offset);
+        for (u64 chunk = 0; chunk < num_chunks; ++chunk) {
+            u32 chunk_size;
+            std::memcpy(&chunk_size, section.stored.data() + chunk * sizeof(u32), sizeof(u32));
+            offset += chunk_size;
+            section.chunk_offsets.push_back(offset);
+        }
+        if (offset != info.size) {
+            ERROR("The chunks of the {} section do not add up to its size", name);
+            return false;
+        }
+    }
+
+    for (u32 type = 0; type < (u32)SectionType::count; ++type) {
+        if (!sections[type].present && expected_sizes[type] != 0) {
+            ERROR("The asset file has no {} section", section_type_name((SectionType)type));
+            return false;
+        }
+    }
+    return true;
+}
+
+struct DecodeJobs {
+    std::span<SectionContents> sections;
+    // Section and chunk of every job, chunk UINT32_MAX verifies the checksum of the section.
+    std::vector<std::pair<u32, u32>> jobs;
+    std::atomic<bool> failed;
+};
+
+static void decode_job(void* context, u32 index) {
+    DecodeJobs& decode = *(DecodeJobs*)context;
+    auto [type, chunk] = decode.jobs[index];
+    SectionContents& section = decode.sections[type];
+    const char* name = section_type_name((SectionType)type);
+
+    if (chunk == UINT32_MAX) {
+        if (xxhash32(section.stored) != section.info.checksum) {
+            ERROR("The checksum of the {} section does not match, the asset file is corrupt",
+                  name);
+            decode.failed = true;
+        }
+        return;
+    }
+
+    u64 begin = (u64)chunk * section.info.chunk_size;
+    u64 size = std::min<u64>(section.info.chunk_size, section.info.uncompressed_size - begin);
+    u64 chunk_begin = section.chunk_offsets[chunk];
+    u64 chunk_end = section.chunk_offsets[chunk + 1];
+    if (!lz4_decompress(section.stored.subspan(chunk_begin, chunk_end - chunk_begin),
+                        section.bytes.subspan(begin, size))) {
+        ERROR("Chunk {} of the {} section is corrupt", chunk, name);
+        decode.failed = true;
+    }
+}
+
+// Verifies the checksums and decompresses the compressed sections into decompressed_memory, on
+// all threads. The image data is only verified when it is compressed, otherwise it would have
+// to be read before the first frame instead of being streamed.
+static bool decode_sections(std::span<SectionContents> sections, AssetFileData& asset_file) {
+    auto start = std::chrono::steady_clock::now();
+
+    u64 decompressed_size = 0;
+    for (const auto& section : sections) {
+        if (section.present && section.info.compression != SectionCompression::none) {
+            decompressed_size += (section.info.uncompressed_size + section_alignment - 1) &
+                                 ~(section_alignment - 1);
+        }
+    }
+    asset_file.decompressed_memory = std::vector<u8>(decompressed_size);
+
+    DecodeJobs decode;
+    decode.sections = sections;
+    decode.failed = false;
+    u64 offset = 0;
+    u64 stored_size = 0;
+    for (u32 type = 0; type < (u32)SectionType::count; ++type) {
+        SectionContents& section = sections[type];
+        if (!section.present) continue;
+        bool compressed = section.info.compression != SectionCompression::none;
+        if (compressed || (SectionType)type != SectionType::image_data) {
+            decode.jobs.push_back({type, UINT32_MAX});
+        }
+        if (!compressed) continue;
+
+        section.bytes = std::span(asset_file.decompressed_memory)
+                            .subspan(offset, section.info.uncompressed_size);
+        offset += (section.info.uncompressed_size + section_alignment - 1) &
+                  ~(section_alignment - 1);
+        stored_size += section.info.size;
+        for (u32 chunk = 0; chunk + 1 < section.chunk_offsets.size(); ++chunk) {
+            decode.jobs.push_back({type, chunk});
+        }
+    }
+
+    JobPool pool;
+    std::atomic<u32> counter = decode.jobs.size();
+    for (u32 i = 0; i < decode.jobs.size(); ++i) {
+        pool.push({.function = decode_job, .context = &decode, .index = i, .counter = &counter});
+    }
+    pool.wait(counter);
+
+    f32 ms = std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - start)
+                 .count();
+    INFO("Decompressed {} MB of sections to {} MB in {:.2f} ms on {} threads", stored_size >> 20,
+         decompressed_size >> 20, ms, pool.get_thread_count());
+    return !decode.failed;
+}
+
+// Maps the file instead of copying it, so the uploads read straight from the page cache and
+// nothing has to be copied through a stream first.
+static bool map_asset_file(const char* path, AssetFileData& asset_file) {
+#ifdef ASSET_LOADER_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = file_stat.st_size;
+
+    // Private and writable so the spans can stay mutable, pages are only copied if written to.
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    // All of the file is uploaded right after loading, start reading it in the background.
+    madvise(mapping, size, MADV_WILLNEED);
+
+    asset_file.mapped_memory = (u8*)mapping;
+    asset_file.mapped_size = size;
+    return true;
+#else
+    (void)path;
+    (void)asset_file;
+    return false;
+#endif
+}
+
+static bool read_asset_file(const char* path, AssetFileData& asset_file) {
     std::ifstream file(path, std::ios::binary | std::ios::ate);
     if (!file.is_open()) {
         ERROR("Failed to open asset file at {}", path);
+        return false;
     }
 
     std::streamsize size = file.tellg();
     file.seekg(0, std::ios::beg);
 
-    AssetFileData asset_file;
     asset_file.backing_memory = std::vector<u8>(size);
     if (!file.read((char*)asset_file.backing_memory.data(), size)) {
         ERROR("Failed to read all the contents of the asset file: {}", path);
+        return false;
     }
+    return true;
+}
 
-    file.close();
+AssetFileData load_asset_file(const char* path) {
+    AssetFileData asset_file;
+    bool mapped = map_asset_file(path, asset_file);
+    if (!mapped && !read_asset_file(path, asset_file)) {
+        exit(1);
+    }
+    std::span<u8> file_bytes = mapped ? std::span(asset_file.mapped_memory, asset_file.mapped_size)
+                                      : std::span(asset_file.backing_memory);
+    if (file_bytes.size() < sizeof(AssetHeader)) {
+        ERROR("Asset file {} is too small to be an asset file", path);
+        exit(1);
+    }
 
-    constexpr u32 expected_version = 2;
+    constexpr u32 expected_version = 7;
 
-    AssetHeader* header = (AssetHeader*)asset_file.backing_memory.data();
+    AssetHeader* header = (AssetHeader*)file_bytes.data();
     if (header->version != expected_version) {
         ERROR(
             "Expected asset file version of {} but got {}, re-build and re-run the asset "
@@ -58,6 +285,7 @@ AssetFileData load_asset_file(const char* path) {
     INFO("Num Vertices: {}", header->num_vertices);
     INFO("Num Meshe: {}", header->num_meshes);
     INFO("Num Primitives: {}", header->num_primitives);
+    INFO("Num Meshlets: {}", header->num_meshlets);
     INFO("Num samplers: {}", header->num_samplers);
     INFO("Num images: {}", header->num_images);
     INFO("Num textures: {}", header->num_textures);
@@ -65,36 +293,69 @@ AssetFileData load_asset_file(const char* path) {
     INFO("Num prefabs: {}", header->num_prefabs);
     INFO("Num name bytes: {}", header->num_name_bytes);
     INFO("Num image bytes: {}", header->num_image_bytes);
-    INFO("Asset file is {} bytes ({} MB)", asset_file.backing_memory.size(),
-         asset_file.backing_memory.size() >> 20);
-
-    u8* end_ptr = asset_file.backing_memory.data() + asset_file.backing_memory.size();
-    u8* ptr = asset_file.backing_memory.data() + sizeof(AssetHeader);
-
-    asset_file.indices = read_asset_data<u8>(ptr, header->num_indices, end_ptr);
-    asset_file.vertices = read_asset_data<Vertex>(ptr, header->num_vertices, end_ptr);
-    asset_file.meshes = read_asset_data<Mesh>(ptr, header->num_meshes, end_ptr);
-    asset_file.primitives = read_asset_data<Primitive>(ptr, header->num_primitives, end_ptr);
-    asset_file.prefab_nodes = read_asset_data<ImmutableNode>(ptr, header->num_prefab_nodes, end_ptr);
-    asset_file.root_prefab_nodes = read_asset_data<u32>(ptr, header->num_prefabs, end_ptr);
-    asset_file.samplers = read_asset_data<SamplerInfo>(ptr, header->num_samplers, end_ptr);
-    asset_file.images = read_asset_data<ImageInfo>(ptr, header->num_images, end_ptr);
-    asset_file.textures = read_asset_data<TextureInfo>(ptr, header->num_textures, end_ptr);
-    asset_file.materials = read_asset_data<Material>(ptr, header->num_materials, end_ptr);
-    asset_file.name_bytes = read_asset_data<u8>(ptr, header->num_name_bytes, end_ptr);
-    asset_file.mesh_names = read_asset_data<AssetManifest::Name>(ptr, header->num_meshes, end_ptr);
-    asset_file.prefab_names = read_asset_data<AssetManifest::Name>(ptr, header->num_prefabs, end_ptr);
-    asset_file.image_data = read_asset_data<u8>(ptr, header->num_image_bytes, end_ptr);
-
-    size_t bytes_read = (size_t)(ptr - asset_file.backing_memory.data());
-    if (bytes_read != asset_file.backing_memory.size()) {
-        ERROR("Asset file is {} bytes but we only read {}, Diff is {}. This should never happen.",
-              asset_file.backing_memory.size(), bytes_read,
-              (int)asset_file.backing_memory.size() - (int)bytes_read);
+    INFO("Num sections: {}", header->num_sections);
+    INFO("Asset file is {} bytes ({} MB), {}", file_bytes.size(), file_bytes.size() >> 20,
+         mapped ? "memory mapped" : "read into memory");
+
+    u8* end_ptr = file_bytes.data() + file_bytes.size();
+    u8* ptr = file_bytes.data() + sizeof(AssetHeader);
+    auto directory = read_asset_data<AssetSection>(ptr, header->num_sections, end_ptr);
+
+    u64 expected_sizes[(u32)SectionType::count] = {
+        header->num_indices,
+        header->num_vertices * sizeof(PackedVertex),
+        header->num_meshes * sizeof(Mesh),
+        header->num_primitives * sizeof(Primitive),
+        header->num_meshlets * sizeof(Meshlet),
+        header->num_prefab_nodes * sizeof(ImmutableNode),
+        header->num_prefabs * sizeof(u32),
+        header->num_samplers * sizeof(SamplerInfo),
+        header->num_images * sizeof(ImageInfo),
+        header->num_textures * sizeof(TextureInfo),
+        header->num_materials * sizeof(Material),
+        header->num_name_bytes,
+        header->num_meshes * sizeof(AssetManifest::Name),
+        header->num_prefabs * sizeof(AssetManifest::Name),
+        header->num_image_bytes,
+    };
+    SectionContents sections[(u32)SectionType::count];
+    if (!parse_sections(file_bytes, directory, expected_sizes, sections) ||
+        !decode_sections(sections, asset_file)) {
+        ERROR("Failed to load the asset file {}, re-run the asset processor!", path);
         exit(1);
     }
 
+    auto section_array = [&]<typename T>(SectionType type) {
+        std::span<u8> bytes = sections[(u32)type].bytes;
+        return std::span<T>((T*)bytes.data(), bytes.size() / sizeof(T));
+    };
+    asset_file.indices = section_array.operator()<u8>(SectionType::indices);
+    asset_file.vertices = section_array.operator()<PackedVertex>(SectionType::vertices);
+    asset_file.meshes = section_array.operator()<Mesh>(SectionType::meshes);
+    asset_file.primitives = section_array.operator()<Primitive>(SectionType::primitives);
+    asset_file.meshlets = section_array.operator()<Meshlet>(SectionType::meshlets);
+    asset_file.prefab_nodes = section_array.operator()<ImmutableNode>(SectionType::prefab_nodes);
+    asset_file.root_prefab_nodes = section_array.operator()<u32>(SectionType::root_prefab_nodes);
+    asset_file.samplers = section_array.operator()<SamplerInfo>(SectionType::samplers);
+    asset_file.images = section_array.operator()<ImageInfo>(SectionType::images);
+    asset_file.textures = section_array.operator()<TextureInfo>(SectionType::textures);
+    asset_file.materials = section_array.operator()<Material>(SectionType::materials);
+    asset_file.name_bytes = section_array.operator()<u8>(SectionType::name_bytes);
+    asset_file.mesh_names = section_array.operator()<AssetManifest::Name>(SectionType::mesh_names);
+    asset_file.prefab_names =
+        section_array.operator()<AssetManifest::Name>(SectionType::prefab_names);
+    asset_file.image_data = section_array.operator()<u8>(SectionType::image_data);
+
     return asset_file;
 }
 
+void unload_asset_file(AssetFileData& data) {
+#ifdef ASSET_LOADER_MMAP
+    if (data.mapped_memory) {
+        munmap(data.mapped_memory, data.mapped_size);
+    }
+#endif
+    data = {};
+}
+
 };  // namespace engine::loader
\ No newline at end of file
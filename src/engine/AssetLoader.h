@@ -20,11 +20,16 @@ namespace engine::loader {
 // "Documentation" for the asset file:
 //struct AssetFile {
 //  AssetHeader header;
-//  u8 indice[num_indices]; (consist of either u16 or u32s as indices)
-//  Vertex vertices[num_vertices];
+//  AssetSection sections[num_sections]; // Where each of the arrays below is stored and how.
+//
+//  // Every array is a section, at a 16 byte aligned offset and in any order.
+//  u8 indice[num_indices]; (consist of either u16 or u32s as indices, the levels of detail of a primitive follow it)
+//  PackedVertex vertices[num_vertices];
 //  Mesh meshes[num_meshes];
 //  Primitive primitives[num_primitives];
+//  Meshlet meshlets[num_meshlets]; // Ranges of the primitive indices, see Primitive::meshlet_index.
 //  ImmutableNode prefab_nodes[num_prefab_nodes];
+//  u32 root_prefab_nodes[num_prefabs];
 //  SamplerInfo samplers[num_samplers];
 //  ImageInfo images[num_images];
 //  TextureInfo textures[num_textures];
@@ -34,6 +39,13 @@ namespace engine::loader {
 //  AssetManifest::Name prefab_names[num_prefabs];
 //  u8 image_data[num_image_bytes]; // Raw image bytes. Format determine by image info.
 //}
+//
+// A compressed section is split into chunks of chunk_size uncompressed bytes (the last one may be
+// shorter) that are compressed on their own, so they can be decompressed in parallel:
+//struct CompressedSection {
+//  u32 chunk_sizes[num_chunks]; // Compressed size of every chunk.
+//  u8 chunks[]; // LZ4 blocks, see utils/compression.h.
+//}
 // clang-format on
 struct AssetHeader {
     u32 version;
@@ -41,6 +53,7 @@ struct AssetHeader {
     u32 num_vertices;
     u32 num_meshes;
     u32 num_primitives;
+    u32 num_meshlets;
     u32 num_prefab_nodes;
     u32 num_samplers;
     u32 num_images;
@@ -50,11 +63,64 @@ struct AssetHeader {
 
     // The manifest description begins here.
     u32 num_name_bytes;
+    u32 num_sections;
 
-    // Image bytes are always last so that we can free it once it is on the GPU.
     u64 num_image_bytes;
 };
 
+enum class SectionType : u32 {
+    indices,
+    vertices,
+    meshes,
+    primitives,
+    meshlets,
+    prefab_nodes,
+    root_prefab_nodes,
+    samplers,
+    images,
+    textures,
+    materials,
+    name_bytes,
+    mesh_names,
+    prefab_names,
+    image_data,
+    count,
+};
+
+inline const char* section_type_name(SectionType type) {
+    constexpr const char* names[] = {
+        "indices",    "vertices",   "meshes",       "primitives", "meshlets",
+        "prefab nodes", "root prefab nodes", "samplers", "images",  "textures",
+        "materials",  "name bytes", "mesh names",   "prefab names", "image data",
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)SectionType::count);
+    return (u32)type < (u32)SectionType::count ? names[(u32)type] : "unknown";
+}
+
+enum class SectionCompression : u32 {
+    none,
+    lz4,
+};
+
+constexpr u64 section_alignment = 16;
+// Chunk size the asset processor compresses with, small enough to spread the large sections over
+// all threads.
+constexpr u32 section_chunk_size = 256 << 10;
+
+struct AssetSection {
+    SectionType type;
+    SectionCompression compression;
+    // Bytes from the start of the file.
+    u64 offset;
+    // Bytes stored in the file.
+    u64 size;
+    u64 uncompressed_size;
+    // Uncompressed bytes per chunk of a compressed section.
+    u32 chunk_size;
+    // XXH32 of the stored bytes.
+    u32 checksum;
+};
+
 struct SamplerInfo {
     Sampler::Filter mag_filter;
     Sampler::Filter min_filter;
@@ -70,11 +136,18 @@ struct Prefab {
 };
 
 struct AssetFileData {
+    // The file is memory mapped where supported and the spans below point into the mapping,
+    // otherwise it is read into backing_memory.
+    u8* mapped_memory = nullptr;
+    size_t mapped_size = 0;
     std::vector<u8> backing_memory;
+    // Compressed sections are decompressed into this, the others are used in place.
+    std::vector<u8> decompressed_memory;
     std::span<u8> indices;
-    std::span<Vertex> vertices;
+    std::span<PackedVertex> vertices;
     std::span<Mesh> meshes;
     std::span<Primitive> primitives;
+    std::span<Meshlet> meshlets;
     std::span<ImmutableNode> prefab_nodes;
     std::span<u32> root_prefab_nodes;
     std::span<SamplerInfo> samplers;
@@ -90,5 +163,8 @@ struct AssetFileData {
 };
 
 AssetFileData load_asset_file(const char* path);
+// Unmaps or frees the file, the spans are empty afterwards. Call it once the scene and the
+// renderer have been created from the data.
+void unload_asset_file(AssetFileData& data);
 
 }  // namespace engine
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "AssetStreamer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#include "graphics/Image.h"
+#include "utils/logging.h"
+
+namespace engine {
+
+// Bytes of image data read by Image::upload, the faces are not laid out contiguously.
+static u64 image_size(const ImageInfo& info) {
+    u64 size = 0;
+    for (u32 face = 0; face < info.num_faces; ++face) {
+        for (u32 level = 0; level < info.num_levels; ++level) {
+            u64 end = (u64)info.level_offset(face, level) + info.level_size(level);
+            size = std::max(size, end);
+        }
+    }
+    return size;
+}
+
+static bool is_valid_image(const ImageInfo& info, u64 num_image_bytes) {
+    if ((u32)info.format > (u32)ImageInfo::Format::RGB8_UNORM) return false;
+    if (info.width == 0 || info.height == 0) return false;
+    if (info.num_levels == 0 || (std::max(info.width, info.height) >> (info.num_levels - 1)) == 0) {
+        return false;
+    }
+    if (info.num_faces != (info.is_cubemap ? 6u : 1u)) return false;
+    return info.image_data_index <= num_image_bytes &&
+           image_size(info) <= num_image_bytes - info.image_data_index;
+}
+
+void AssetStreamer::init(u32 num_workers, u32 staging_capacity) {
+    // The pool counts the thread waiting on it, which never happens here.
+    m_workers = std::make_unique<JobPool>(std::max(num_workers, 1u) + 1);
+    m_staging.init(staging_capacity, 16);
+    m_max_ready_bytes = staging_capacity;
+    m_pending_reads = 0;
+    m_num_images = 0;
+    m_num_finished = 0;
+    m_ready_bytes = 0;
+    m_stopping = false;
+}
+
+void AssetStreamer::deinit() {
+    {
+        std::lock_guard<std::mutex> lock(m_ready_mutex);
+        m_stopping = true;
+    }
+    m_ready_space.notify_all();
+    m_workers.reset();
+    m_ready.clear();
+    loader::unload_asset_file(m_data);
+    m_staging.deinit();
+}
+
+void AssetStreamer::stream_images(const Scene& scene, loader::AssetFileData&& data) {
+    assert(!is_streaming());
+    assert(scene.m_images.size() == data.images.size());
+    m_data = std::exchange(data, {});
+    m_num_images = m_data.images.size();
+    m_num_finished = 0;
+    INFO("Streaming {} images ({} MB)", m_num_images, m_data.image_data.size() >> 20);
+
+    m_pending_reads.store(m_num_images, std::memory_order_relaxed);
+    for (u32 i = 0; i < m_num_images; ++i) {
+        m_workers->push({
+            .function = read_image,
+            .context = this,
+            .index = i,
+            .counter = &m_pending_reads,
+        });
+    }
+    if (m_num_images == 0) finish();
+}
+
+void AssetStreamer::read_image(void* context, u32 index) {
+    AssetStreamer& streamer = *(AssetStreamer*)context;
+    const ImageInfo& info = streamer.m_data.images[index];
+    bool valid = is_valid_image(info, streamer.m_data.image_data.size());
+    u64 size = valid ? image_size(info) : 0;
+
+    {
+        std::unique_lock<std::mutex> lock(streamer.m_ready_mutex);
+        streamer.m_ready_space.wait(lock, [&] {
+            return streamer.m_stopping || streamer.m_ready_bytes < streamer.m_max_ready_bytes;
+        });
+        if (streamer.m_stopping) return;
+    }
+
+    // Touching every page faults the image in here instead of on the render thread, the file is
+    // memory mapped.
+    if (valid) {
+        const volatile u8* bytes = &streamer.m_data.image_data[info.image_data_index];
+        for (u64 offset = 0; offset < size; offset += 4096) {
+            (void)bytes[offset];
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(streamer.m_ready_mutex);
+    streamer.m_ready.push_back({.image_index = index, .valid = valid});
+    streamer.m_ready_bytes += size;
+}
+
+void AssetStreamer::update(Scene& scene, f32 budget_ms) {
+    if (!is_streaming()) return;
+
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed_ms = [&]() {
+        return std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+    };
+
+    bool staged = false;
+    u32 uploaded = 0;
+    while (uploaded == 0 || elapsed_ms() < budget_ms) {
+        ReadyImage ready;
+        {
+            std::lock_guard<std::mutex> lock(m_ready_mutex);
+            if (m_ready.empty()) break;
+            ready = m_ready.front();
+        }
+
+        if (ready.valid) {
+            Image& image = scene.m_images[ready.image_index];
+            u64 size = image_size(image.m_info);
+            u8* bytes = &m_data.image_data[image.m_info.image_data_index];
+            if (size <= m_staging.capacity()) {
+                u32 offset = m_staging.allocate(size);
+                // Full of this frame's uploads, the rest waits for the next one.
+                if (offset == RingBuffer<GLRingBackend>::allocation_failed) break;
+                std::memcpy(m_staging.data(offset), bytes, size);
+                image.upload_from_buffer(m_staging.m_backend.handle, offset);
+                staged = true;
+            } else {
+                image.upload(bytes);
+            }
+            scene.m_num_resident_images++;
+            uploaded++;
+        } else {
+            ERROR("Image {} of the asset file is invalid, it is drawn with a placeholder",
+                  ready.image_index);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_ready_mutex);
+            m_ready.pop_front();
+            if (ready.valid) m_ready_bytes -= image_size(m_data.images[ready.image_index]);
+        }
+        m_ready_space.notify_all();
+        m_num_finished++;
+    }
+
+    if (staged) m_staging.end_frame();
+    if (!is_streaming()) finish();
+}
+
+void AssetStreamer::finish() {
+    loader::unload_asset_file(m_data);
+    INFO("Streamed {} images", m_num_images);
+}
+
+};  // namespace engine
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "AssetLoader.h"
+#include "core.h"
+#include "ecs/jobpool.hpp"
+#include "graphics/RingBuffer.h"
+#include "scene/Scene.h"
+
+namespace engine {
+
+// Uploads the images of an asset file while the game is already running. Worker threads read and
+// validate the bytes of every image, the render thread uploads the images that are ready through
+// a persistently mapped pixel unpack buffer in update, limited to a time budget per frame. Until
+// then the renderer draws placeholders in place of the images.
+class AssetStreamer {
+   public:
+    // Staging memory is shared by the uploads of the frames in flight, images larger than it are
+    // uploaded from the file directly.
+    void init(u32 num_workers, u32 staging_capacity);
+    // Stops reading images that are not read yet and waits for the workers.
+    void deinit();
+
+    // Takes over the file, the images of the scene must have been created from it by
+    // Scene::init. The file is unloaded once all of its images are resident, only then can the
+    // next one be streamed.
+    void stream_images(const Scene& scene, loader::AssetFileData&& data);
+    // Uploads images that are ready until budget_ms has passed, but at least one. Call it once
+    // per frame from the render thread.
+    void update(Scene& scene, f32 budget_ms);
+
+    bool is_streaming() const { return m_num_finished < m_num_images; }
+    u32 get_num_images() const { return m_num_images; }
+    u32 get_num_finished() const { return m_num_finished; }
+
+   private:
+    struct ReadyImage {
+        u32 image_index;
+        bool valid;
+    };
+
+    // Job of the workers, index is the image.
+    static void read_image(void* context, u32 index);
+    void finish();
+
+    // Read images are held back once this many bytes of them wait for upload, so the workers do
+    // not fault in the whole file ahead of the uploads.
+    u64 m_max_ready_bytes;
+    std::unique_ptr<JobPool> m_workers;
+    std::atomic<u32> m_pending_reads;
+    loader::AssetFileData m_data;
+    u32 m_num_images;
+    u32 m_num_finished;
+
+    std::mutex m_ready_mutex;
+    std::condition_variable m_ready_space;
+    std::deque<ReadyImage> m_ready;
+    u64 m_ready_bytes;
+    bool m_stopping;
+
+    RingBuffer<GLRingBackend> m_staging;
+};
+
+};  // namespace engine
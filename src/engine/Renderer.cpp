@@ -2,10 +2,12 @@
 
 #include <glad/glad.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <glm/gtc/type_ptr.hpp>
 #include <sstream>
@@ -15,12 +17,12 @@
 #include "glm/fwd.hpp"
 #include "graphics/Image.h"
 #include "graphics/Pipeline.h"
+#include "graphics/RenderQueue.h"
 #include "graphics/Sampler.h"
 #include "scene/Node.h"
 #include "utils/logging.h"
 
 // Thins we can do to improve performance:
-// Decrease size of vertices (half precision etc)
 // Pack textures better instead of using RGBA BC7 for *most color data*
 
 // Super temp
@@ -46,6 +48,21 @@ void Renderer::init(LoadProc load_proc) {
     INFO("Intiliazing renderer");
     m_scene_loaded = false;
     m_pass_in_progress = false;
+    m_submission_mode = SubmissionMode::direct;
+    m_material_table = 0;
+    m_material_parameters = 0;
+    m_primitive_bounds = 0;
+    m_material_table_scene = nullptr;
+    m_material_table_resident_images = 0;
+    m_texture_filtering_level = 1.0f;
+    m_draw_call_count = 0;
+    m_primitives_tested = 0;
+    m_primitives_visible = 0;
+    m_meshlet_culling = false;
+    m_meshlets_tested = 0;
+    m_meshlets_visible = 0;
+    m_lod_error_threshold = 1.0f;
+    std::fill(std::begin(m_lod_draw_counts), std::end(m_lod_draw_counts), 0);
 
     if (!gladLoadGLLoader((GLADloadproc)load_proc)) {
         ERROR("Failed to load OpenGL function pointers");
@@ -63,13 +80,16 @@ void Renderer::init(LoadProc load_proc) {
     glFrontFace(GL_CCW);
 
     glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &m_max_texture_filtering);
+    m_bindless_supported = GLAD_GL_ARB_bindless_texture != 0;
 
     m_default_sampler.init(Sampler::Filter::linear, Sampler::Filter::linear,
                            Sampler::MipmapMode::linear, Sampler::AddressMode::clamp_to_edge,
                            Sampler::AddressMode::clamp_to_edge, Sampler::AddressMode::clamp_to_edge,
                            m_max_texture_filtering);
 
+    create_placeholder_images();
     create_ubos();
+    create_frame_data(4 << 20);
     generate_offline_content();
     create_skybox();
     INFO("Initialized renderer");
@@ -82,6 +102,17 @@ void Renderer::set_texture_filtering_level(Scene& scene, f32 level) {
     for (size_t i = 0; i < scene.m_samplers.size(); ++i) {
         glSamplerParameterf(scene.m_samplers[i].m_handle, GL_TEXTURE_MAX_ANISOTROPY, level);
     }
+    m_texture_filtering_level = level;
+    // The bindless samplers are immutable, rebuild the material table in the next pass.
+    m_material_table_scene = nullptr;
+}
+
+void Renderer::set_submission_mode(SubmissionMode mode) {
+    if (mode == SubmissionMode::indirect && !m_bindless_supported) {
+        WARN("Indirect submission needs GL_ARB_bindless_texture, using direct submission");
+        mode = SubmissionMode::direct;
+    }
+    m_submission_mode = mode;
 }
 
 void Renderer::make_resources_for_scene(const loader::AssetFileData &data) {
@@ -90,22 +121,23 @@ void Renderer::make_resources_for_scene(const loader::AssetFileData &data) {
     m_pbr_pipeline.init();
 
     std::array<VertexAttributeDescriptor, 4> attribs = {
-        VertexAttributeDescriptor{.type = VertexAttributeDescriptor::Type::f32,
+        VertexAttributeDescriptor{.type = VertexAttributeDescriptor::Type::snorm16,
+                                  .count = 2,
+                                  .offset = offsetof(PackedVertex, tangent)},
+        VertexAttributeDescriptor{.type = VertexAttributeDescriptor::Type::unorm16,
                                   .count = 4,
-                                  .offset = offsetof(Vertex, tangent)},
-        VertexAttributeDescriptor{.type = VertexAttributeDescriptor::Type::f32,
-                                  .count = 3,
-                                  .offset = offsetof(Vertex, pos)},
-        VertexAttributeDescriptor{.type = VertexAttributeDescriptor::Type::f32,
-                                  .count = 3,
-                                  .offset = offsetof(Vertex, normal)},
-        VertexAttributeDescriptor{.type = VertexAttributeDescriptor::Type::f32,
+                                  .offset = offsetof(PackedVertex, pos)},
+        VertexAttributeDescriptor{.type = VertexAttributeDescriptor::Type::snorm16,
                                   .count = 2,
-                                  .offset = offsetof(Vertex, uv)},
+                                  .offset = offsetof(PackedVertex, normal)},
+        VertexAttributeDescriptor{.type = VertexAttributeDescriptor::Type::f16,
+                                  .count = 2,
+                                  .offset = offsetof(PackedVertex, uv)},
     };
 
-    std::span vertex_data((u8 *)data.vertices.data(), data.vertices.size() * sizeof(Vertex));
-    m_pbr_pipeline.add_vertex_buffer(attribs, sizeof(Vertex), vertex_data);
+    std::span vertex_data((u8 *)data.vertices.data(),
+                          data.vertices.size() * sizeof(PackedVertex));
+    m_pbr_pipeline.add_vertex_buffer(attribs, sizeof(PackedVertex), vertex_data);
     m_pbr_pipeline.add_index_buffer(data.indices);
 
     std::array<u32, 1> specialization_constants = {m_offline_images.env_map.m_info.num_levels};
@@ -115,6 +147,28 @@ void Renderer::make_resources_for_scene(const loader::AssetFileData &data) {
     assert(m_pbr_pipeline.m_fshader && "Failed to load PBR fragment shader");
     m_pbr_pipeline.compile();
 
+    create_material_parameters(data.materials);
+    create_primitive_bounds(data.primitives);
+
+    // Bindless textures can not be used from SPIR-V, so the indirect variant is compiled from
+    // the GLSL sources at runtime.
+    if (m_bindless_supported) {
+        std::array<std::string, 2> defines = {
+            "BINDLESS_MATERIALS",
+            std::format("ENV_MAP_MIP_COUNT {}u", m_offline_images.env_map.m_info.num_levels),
+        };
+        m_pbr_indirect_pipeline.init_shared(m_pbr_pipeline);
+        m_pbr_indirect_pipeline.add_vertex_shader_src("shaders/basic.vert.glsl", defines);
+        m_pbr_indirect_pipeline.add_fragment_shader_src("shaders/basic.frag.glsl", defines);
+        if (m_pbr_indirect_pipeline.m_vshader == UINT32_MAX ||
+            m_pbr_indirect_pipeline.m_fshader == UINT32_MAX) {
+            WARN("Failed to compile the indirect PBR pipeline, indirect submission is disabled");
+            m_bindless_supported = false;
+        } else {
+            m_pbr_indirect_pipeline.compile();
+        }
+    }
+
     m_scene_loaded = true;
     INFO("Created renderer state for scene object.");
 }
@@ -142,78 +196,498 @@ void Renderer::begin_pass(const Scene &scene, const Camera &camera, u32 width, u
     matrices.view = camera.get_view_matrix();
     matrices.projection = glm::perspective(glm::radians(90.0f), aspect_ratio, 0.1f, 1000.0f);
 
-    glNamedBufferSubData(m_ubo_matrices_handle, 0, sizeof(UBOMatrices), &matrices);
+    m_draw_call_count = 0;
+    m_primitives_tested = 0;
+    m_primitives_visible = 0;
+    m_meshlets_tested = 0;
+    m_meshlets_visible = 0;
+    std::fill(std::begin(m_lod_draw_counts), std::end(m_lod_draw_counts), 0);
+
+    if (m_submission_mode == SubmissionMode::indirect) {
+        if (m_material_table_scene != &scene ||
+            m_material_table_resident_images != scene.m_num_resident_images) {
+            create_material_table(scene);
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_material_table);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_material_parameters);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_primitive_bounds);
     m_curr_pass = {
         .scene = &scene,
         .projection_matrix = matrices.projection,
         .view_matrix = matrices.view,
         .camera_pos = camera.m_pos,
+        .frustum = Frustum::from_view_projection(matrices.projection * matrices.view),
+        .lod_error_scale = matrices.projection[1][1] * 0.5f * (f32)height,
     };
     m_pass_in_progress = true;
 }
 
 void Renderer::end_pass() {
+    submit_queue();
     draw_skybox();
+    m_frame_data.end_frame();
     glDisable(GL_FRAMEBUFFER_SRGB);
     assert(m_pass_in_progress);
     m_pass_in_progress = false;
 }
 
+// Only one pipeline draws scene geometry for now, the skybox is drawn separately in end_pass.
+static constexpr u32 pbr_pipeline_key = 0;
+
 void Renderer::draw_mesh(u32 mesh_handle, const glm::mat4 &transform) {
     const auto &scene = *m_curr_pass.scene;
-
-    // FIXME: Do the actual draw calls in end_pass
     const auto &mesh = scene.m_meshes[mesh_handle];
-    glNamedBufferSubData(m_ubo_matrices_handle, 0, sizeof(glm::mat4), glm::value_ptr(transform));
+
+    f32 view_depth = -(m_curr_pass.view_matrix * transform[3]).z;
+    u32 transform_index = m_queue.push_transform(transform);
 
     for (size_t i = 0; i < mesh.num_primitives; ++i) {
-        const auto &prim = scene.m_primitives[mesh.primitive_index + i];
-        const auto &material = scene.m_materials[prim.material_index];
+        record_primitive(scene, mesh.primitive_index + i, transform_index, view_depth);
+    }
+}
 
-        if ((u32)material.flags & (u32)Material::Flags::has_base_color_texture) {
-            const auto &base_color_texture = scene.m_textures[material.base_color_texture];
-            glBindSampler(0, scene.m_samplers[base_color_texture.sampler_index].m_handle);
-            glBindTextureUnit(0, scene.m_images[base_color_texture.image_index].m_handle);
-        }
-        if ((u32)material.flags & (u32)Material::Flags::has_metallic_roughness_texture) {
-            const auto &metallic_roughness_texture =
-                scene.m_textures[material.metallic_roughness_texture];
-            glBindSampler(1, scene.m_samplers[metallic_roughness_texture.sampler_index].m_handle);
-            glBindTextureUnit(1, scene.m_images[metallic_roughness_texture.image_index].m_handle);
-        }
-        if ((u32)material.flags & (u32)Material::Flags::has_normal_map) {
-            const auto &normal_map = scene.m_textures[material.normal_map];
-            glBindSampler(2, scene.m_samplers[normal_map.sampler_index].m_handle);
-            glBindTextureUnit(2, scene.m_images[normal_map.image_index].m_handle);
-        }
-        if ((u32)material.flags & (u32)Material::Flags::has_occlusion_map) {
-            const auto &occlusion_map = scene.m_textures[material.occlusion_map];
-            glBindSampler(3, scene.m_samplers[occlusion_map.sampler_index].m_handle);
-            glBindTextureUnit(3, scene.m_images[occlusion_map.image_index].m_handle);
-        }
-        if ((u32)material.flags & (u32)Material::Flags::has_emission_map) {
-            const auto &emission_map = scene.m_textures[material.emission_map];
-            glBindSampler(4, scene.m_samplers[emission_map.sampler_index].m_handle);
-            glBindTextureUnit(4, scene.m_images[emission_map.image_index].m_handle);
+u32 Renderer::select_lod(const Primitive &prim, const glm::mat4 &transform) const {
+    if (prim.num_lods <= 1 || m_lod_error_threshold <= 0.0f) return 0;
+
+    // The error is scaled like the largest axis and seen from the closest point of the bounds.
+    f32 scale = std::max({glm::length(glm::vec3(transform[0])),
+                          glm::length(glm::vec3(transform[1])),
+                          glm::length(glm::vec3(transform[2]))});
+    glm::vec3 center = glm::vec3(transform * glm::vec4(prim.bounds.sphere_center, 1.0f));
+    f32 distance = glm::length(center - m_curr_pass.camera_pos) - prim.bounds.sphere_radius * scale;
+    if (distance <= 0.0f) return 0;
+
+    f32 pixels_per_unit = scale * m_curr_pass.lod_error_scale / distance;
+    u32 lod = 0;
+    while (lod + 1 < prim.num_lods &&
+           prim.lods[lod + 1].error * pixels_per_unit <= m_lod_error_threshold) {
+        lod++;
+    }
+    return lod;
+}
+
+void Renderer::record_primitive(const Scene &scene, u32 primitive_index, u32 transform_index,
+                                f32 view_depth) {
+    const auto &prim = scene.m_primitives[primitive_index];
+    u32 lod = select_lod(prim, m_queue.m_transforms[transform_index]);
+    m_lod_draw_counts[lod]++;
+    u64 key =
+        SortKey::make(pbr_pipeline_key, prim.material_index, primitive_index, lod, view_depth);
+    m_queue.push(key, primitive_index, transform_index);
+}
+
+void Renderer::bind_material(const Scene &scene, u32 material_index) {
+    const auto &material = scene.m_materials[material_index];
+
+    // The texture units match the placeholder slots.
+    auto bind_texture = [&](u32 unit, u32 texture_index) {
+        const auto &texture = scene.m_textures[texture_index];
+        const auto &image = scene.m_images[texture.image_index];
+        if (image.m_resident) {
+            glBindSampler(unit, scene.m_samplers[texture.sampler_index].m_handle);
+            glBindTextureUnit(unit, image.m_handle);
+        } else {
+            glBindSampler(unit, m_default_sampler.m_handle);
+            glBindTextureUnit(unit, m_placeholder_images[unit].m_handle);
         }
+    };
 
-        // set uniforms for the material.
-        GPUMaterial gpu_material = {
+    if ((u32)material.flags & (u32)Material::Flags::has_base_color_texture) {
+        bind_texture(0, material.base_color_texture);
+    }
+    if ((u32)material.flags & (u32)Material::Flags::has_metallic_roughness_texture) {
+        bind_texture(1, material.metallic_roughness_texture);
+    }
+    if ((u32)material.flags & (u32)Material::Flags::has_normal_map) {
+        bind_texture(2, material.normal_map);
+    }
+    if ((u32)material.flags & (u32)Material::Flags::has_occlusion_map) {
+        bind_texture(3, material.occlusion_map);
+    }
+    if ((u32)material.flags & (u32)Material::Flags::has_emission_map) {
+        bind_texture(4, material.emission_map);
+    }
+}
+
+void Renderer::create_placeholder_images() {
+    const u8 texels[5][3] = {
+        {255, 255, 255},
+        {255, 255, 255},
+        {128, 128, 255},
+        {255, 255, 255},
+        {0, 0, 0},
+    };
+    for (u32 slot = 0; slot < 5; ++slot) {
+        m_placeholder_images[slot].init({
+            .format = ImageInfo::Format::RGB8_UNORM,
+            .width = 1,
+            .height = 1,
+            .num_levels = 1,
+            .num_faces = 1,
+        });
+        m_placeholder_images[slot].upload((u8 *)texels[slot]);
+    }
+}
+
+void Renderer::create_primitive_bounds(std::span<const Primitive> primitives) {
+    std::vector<GPUPrimitiveBounds> bounds;
+    bounds.reserve(primitives.size());
+    for (const auto &prim : primitives) {
+        bounds.push_back({
+            .aabb_min = glm::vec4(prim.bounds.aabb_min, 0.0f),
+            .aabb_extent = glm::vec4(prim.bounds.aabb_max - prim.bounds.aabb_min, 0.0f),
+        });
+    }
+
+    glCreateBuffers(1, &m_primitive_bounds);
+    glNamedBufferStorage(m_primitive_bounds,
+                         std::max<size_t>(bounds.size(), 1) * sizeof(GPUPrimitiveBounds),
+                         bounds.data(), 0);
+}
+
+void Renderer::create_material_parameters(std::span<const Material> scene_materials) {
+    std::vector<GPUMaterial> materials;
+    materials.reserve(scene_materials.size());
+    for (const auto &material : scene_materials) {
+        materials.push_back({
             .base_color_factor = material.base_color_factor,
             .metallic_roughness_normal_occlusion =
                 glm::vec4(material.metallic_factor, material.roughness_factor,
                           material.normal_map_scale, material.occlusion_strength),
-            .camera_pos = m_curr_pass.camera_pos,
+            .emissive_factor = material.emission_factor,
             .flags = (u32)material.flags,
+        });
+    }
+
+    // Materials never change after loading, so the table is immutable.
+    glCreateBuffers(1, &m_material_parameters);
+    glNamedBufferStorage(m_material_parameters,
+                         std::max<size_t>(materials.size(), 1) * sizeof(GPUMaterial),
+                         materials.data(), 0);
+}
+
+void Renderer::create_frame_data(u32 capacity) {
+    i32 uniform_alignment, storage_alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+    m_frame_data_alignment = std::max(uniform_alignment, storage_alignment);
+    m_frame_data.init(capacity, m_frame_data_alignment);
+}
+
+void Renderer::reserve_frame_data(u32 size) {
+    // A frame wasting the end of the buffer when it wraps uses at most twice its size, so with
+    // room for frames_in_flight frames allocations of the frame never fail.
+    u32 frames_in_flight = RingBuffer<GLRingBackend>::frames_in_flight;
+    if (size * frames_in_flight <= m_frame_data.capacity()) return;
+
+    // Rare, the buffer is immutable so wait for the GPU and replace it.
+    glFinish();
+    m_frame_data.deinit();
+    create_frame_data(std::max(size * frames_in_flight, m_frame_data.capacity() * 2));
+}
+
+u32 Renderer::push_frame_data(const void *data, u32 size) {
+    u32 offset = m_frame_data.allocate(size);
+    assert(offset != RingBuffer<GLRingBackend>::allocation_failed);
+    std::memcpy(m_frame_data.data(offset), data, size);
+    return offset;
+}
+
+void Renderer::create_material_table(const Scene &scene) {
+    for (u64 handle : m_bindless_handles) {
+        glMakeTextureHandleNonResidentARB(handle);
+    }
+    m_bindless_handles.clear();
+    if (m_material_table) {
+        glDeleteBuffers(1, &m_material_table);
+    }
+
+    // Samplers that already have bindless handles can not be changed, they are leaked when the
+    // filtering level changes which is rare enough to not matter. Rebuilds for streamed images
+    // keep them.
+    if (m_material_table_scene != &scene) {
+        m_bindless_samplers.clear();
+        for (const auto &scene_sampler : scene.m_samplers) {
+            Sampler sampler;
+            sampler.init(scene_sampler.m_mag_filter, scene_sampler.m_min_filter,
+                         scene_sampler.m_mipmap_mode, scene_sampler.m_address_mode_u,
+                         scene_sampler.m_address_mode_v, scene_sampler.m_address_mode_w,
+                         m_texture_filtering_level);
+            m_bindless_samplers.push_back(sampler);
+        }
+    }
+
+    // Every texture that is not resident yet shares the placeholder of its slot.
+    u64 placeholder_handles[5];
+    for (u32 slot = 0; slot < 5; ++slot) {
+        placeholder_handles[slot] = glGetTextureSamplerHandleARB(
+            m_placeholder_images[slot].m_handle, m_default_sampler.m_handle);
+        glMakeTextureHandleResidentARB(placeholder_handles[slot]);
+        m_bindless_handles.push_back(placeholder_handles[slot]);
+    }
+
+    auto texture_handle = [&](u32 slot, u32 texture_index) {
+        const auto &texture = scene.m_textures[texture_index];
+        if (!scene.m_images[texture.image_index].m_resident) return placeholder_handles[slot];
+        u64 handle = glGetTextureSamplerHandleARB(scene.m_images[texture.image_index].m_handle,
+                                                  m_bindless_samplers[texture.sampler_index].m_handle);
+        glMakeTextureHandleResidentARB(handle);
+        m_bindless_handles.push_back(handle);
+        return handle;
+    };
+
+    std::vector<GPUBindlessMaterial> materials;
+    materials.reserve(scene.m_materials.size());
+    for (const auto &material : scene.m_materials) {
+        u32 flags = (u32)material.flags;
+        GPUBindlessMaterial gpu_material = {
+            .base_color_factor = material.base_color_factor,
+            .metallic_roughness_normal_occlusion =
+                glm::vec4(material.metallic_factor, material.roughness_factor,
+                          material.normal_map_scale, material.occlusion_strength),
             .emissive_factor = material.emission_factor,
+            .flags = flags,
+            .textures = {},
         };
-        glNamedBufferSubData(m_ubo_material_handle, 0, sizeof(GPUMaterial), &gpu_material);
+        if (flags & (u32)Material::Flags::has_base_color_texture) {
+            gpu_material.textures[0] = texture_handle(0, material.base_color_texture);
+        }
+        if (flags & (u32)Material::Flags::has_metallic_roughness_texture) {
+            gpu_material.textures[1] = texture_handle(1, material.metallic_roughness_texture);
+        }
+        if (flags & (u32)Material::Flags::has_normal_map) {
+            gpu_material.textures[2] = texture_handle(2, material.normal_map);
+        }
+        if (flags & (u32)Material::Flags::has_occlusion_map) {
+            gpu_material.textures[3] = texture_handle(3, material.occlusion_map);
+        }
+        if (flags & (u32)Material::Flags::has_emission_map) {
+            gpu_material.textures[4] = texture_handle(4, material.emission_map);
+        }
+        materials.push_back(gpu_material);
+    }
+
+    glCreateBuffers(1, &m_material_table);
+    glNamedBufferStorage(m_material_table,
+                         std::max<size_t>(materials.size(), 1) * sizeof(GPUBindlessMaterial),
+                         materials.data(), 0);
+    m_material_table_scene = &scene;
+    m_material_table_resident_images = scene.m_num_resident_images;
+}
+
+static u32 index_type_slot(u32 index_type) {
+    switch (index_type) {
+        case GL_UNSIGNED_BYTE: return 0;
+        case GL_UNSIGNED_SHORT: return 1;
+        case GL_UNSIGNED_INT: return 2;
+        default: assert(0); return 2;
+    }
+}
+
+// Draws the recorded items in key order. Items drawing the same primitive are adjacent after
+// sorting, their matrices are written next to each other and drawn as one instanced draw. The
+// direct path issues those draws one by one and only binds materials when they change, the
+// indirect path writes them as commands and issues one multi draw per index type. With meshlet
+// culling a primitive with meshlets becomes a command per visible run of meshlets per instance.
+// Instances of a primitive at different levels of detail are separate groups.
+void Renderer::submit_queue() {
+    const auto &scene = *m_curr_pass.scene;
+    bool indirect = m_submission_mode == SubmissionMode::indirect;
+    bool meshlets = m_meshlet_culling && !scene.m_meshlets.empty();
+    m_queue.sort();
+    u32 item_count = m_queue.size();
+
+    // Zero sized ranges can not be bound.
+    u32 instance_count = std::max(item_count, 1u);
+
+    // Upper bound of the commands, every visible meshlet can become a command of its own.
+    u32 command_capacity = 0;
+    if (indirect || meshlets) {
+        for (u32 i = 0; i < item_count; ++i) {
+            const auto &prim = scene.m_primitives[m_queue.m_items[i].primitive_index];
+            command_capacity += meshlets && prim.num_meshlets > 0 ? prim.num_meshlets : 1;
+        }
+        command_capacity = std::max(command_capacity, 1u);
+    }
+
+    // Two matrix blocks, the second one is the skybox's, and alignment padding of every
+    // allocation of the frame.
+    u32 frame_size = 2 * sizeof(UBOMatrices) + sizeof(glm::vec4) +
+                     instance_count * (sizeof(glm::mat4) + sizeof(InstanceDraw)) +
+                     command_capacity * sizeof(DrawElementsIndirectCommand) +
+                     6 * m_frame_data_alignment;
+    reserve_frame_data(frame_size);
+    u32 frame_buffer = m_frame_data.m_backend.handle;
+
+    UBOMatrices matrices = {
+        .model = glm::mat4(1.0f),
+        .view = m_curr_pass.view_matrix,
+        .projection = m_curr_pass.projection_matrix,
+    };
+    u32 matrices_offset = push_frame_data(&matrices, sizeof(UBOMatrices));
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, frame_buffer, matrices_offset, sizeof(UBOMatrices));
+    glm::vec4 pass_camera_pos = glm::vec4(m_curr_pass.camera_pos, 1.0f);
+    u32 pass_offset = push_frame_data(&pass_camera_pos, sizeof(glm::vec4));
+    glBindBufferRange(GL_UNIFORM_BUFFER, 3, frame_buffer, pass_offset, sizeof(glm::vec4));
+
+    u32 instances_offset = m_frame_data.allocate(instance_count * sizeof(glm::mat4));
+    u32 instance_draws_offset = m_frame_data.allocate(instance_count * sizeof(InstanceDraw));
+    auto *instances = (glm::mat4 *)m_frame_data.data(instances_offset);
+    auto *instance_draws = (InstanceDraw *)m_frame_data.data(instance_draws_offset);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, frame_buffer, instances_offset,
+                      instance_count * sizeof(glm::mat4));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 4, frame_buffer, instance_draws_offset,
+                      instance_count * sizeof(InstanceDraw));
+
+    u32 commands_offset = 0;
+    DrawElementsIndirectCommand *commands = nullptr;
+    u32 command_count = 0;
+    if (command_capacity > 0) {
+        commands_offset =
+            m_frame_data.allocate(command_capacity * sizeof(DrawElementsIndirectCommand));
+        commands = (DrawElementsIndirectCommand *)m_frame_data.data(commands_offset);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, frame_buffer);
+    }
+
+    if (indirect) {
+        m_pbr_indirect_pipeline.bind();
+        for (auto &commands : m_indirect_commands) {
+            commands.clear();
+        }
+    }
+
+    u32 bound_material = UINT32_MAX;
+    u32 first = 0;
+    while (first < item_count) {
+        u32 primitive_index = m_queue.m_items[first].primitive_index;
+        u32 lod = SortKey::lod(m_queue.m_items[first].sort_key);
+        u32 last = first;
+        while (last < item_count && m_queue.m_items[last].primitive_index == primitive_index &&
+               SortKey::lod(m_queue.m_items[last].sort_key) == lod) {
+            instances[last] = m_queue.m_transforms[m_queue.m_items[last].transform_index];
+            last++;
+        }
+
+        const auto &prim = scene.m_primitives[primitive_index];
+        const auto &prim_lod = prim.lods[lod];
+        bool cull_meshlets = meshlets && prim.num_meshlets > 0 && lod == 0;
+        // Meshlet commands draw a single instance each, so every instance is a base instance.
+        for (u32 i = first; i < (cull_meshlets ? last : first + 1); ++i) {
+            instance_draws[i] = {
+                .material_index = prim.material_index,
+                .primitive_index = primitive_index,
+            };
+        }
+        if (indirect) {
+            u32 slot = index_type_slot(prim.index_type);
+            if (cull_meshlets) {
+                append_meshlet_commands(scene, prim, first, last, m_indirect_commands[slot]);
+                first = last;
+                continue;
+            }
+            m_indirect_commands[slot].push_back({
+                .count = prim.num_indices(lod),
+                .instance_count = last - first,
+                .first_index = prim_lod.indices_start >> slot,
+                .base_vertex = (i32)prim.base_vertex,
+                .base_instance = first,
+            });
+            first = last;
+            continue;
+        }
 
-        auto num_indices = prim.num_indices();
-        u64 byte_offset = prim.indices_start;
+        if (prim.material_index != bound_material) {
+            bind_material(scene, prim.material_index);
+            bound_material = prim.material_index;
+        }
 
-        glDrawElementsBaseVertex(GL_TRIANGLES, num_indices, prim.index_type, (void *)byte_offset,
-                                 prim.base_vertex);
+        if (cull_meshlets) {
+            m_meshlet_commands.clear();
+            append_meshlet_commands(scene, prim, first, last, m_meshlet_commands);
+            if (!m_meshlet_commands.empty()) {
+                std::memcpy(commands + command_count, m_meshlet_commands.data(),
+                            m_meshlet_commands.size() * sizeof(DrawElementsIndirectCommand));
+                u64 byte_offset =
+                    commands_offset + command_count * sizeof(DrawElementsIndirectCommand);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, prim.index_type, (void *)byte_offset,
+                                            m_meshlet_commands.size(), 0);
+                command_count += m_meshlet_commands.size();
+                m_draw_call_count++;
+            }
+            first = last;
+            continue;
+        }
+
+        auto num_indices = prim.num_indices(lod);
+        u64 byte_offset = prim_lod.indices_start;
+
+        // The base instance is the index of the first matrix of the group.
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, num_indices, prim.index_type,
+                                                      (void *)byte_offset, last - first,
+                                                      prim.base_vertex, first);
+        m_draw_call_count++;
+        first = last;
+    }
+
+    if (indirect) {
+        static const u32 index_types[3] = {GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT};
+        for (u32 slot = 0; slot < 3; ++slot) {
+            const auto &slot_commands = m_indirect_commands[slot];
+            if (slot_commands.empty()) continue;
+
+            std::memcpy(commands + command_count, slot_commands.data(),
+                        slot_commands.size() * sizeof(DrawElementsIndirectCommand));
+            u64 byte_offset =
+                commands_offset + command_count * sizeof(DrawElementsIndirectCommand);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, index_types[slot], (void *)byte_offset,
+                                        slot_commands.size(), 0);
+            command_count += slot_commands.size();
+            m_draw_call_count++;
+        }
+        m_pbr_pipeline.bind();
+    }
+
+    m_queue.clear();
+}
+
+void Renderer::append_meshlet_commands(const Scene &scene, const Primitive &prim, u32 first,
+                                       u32 last,
+                                       std::vector<DrawElementsIndirectCommand> &commands) {
+    u32 first_index = prim.indices_start >> index_type_slot(prim.index_type);
+    for (u32 i = first; i < last; ++i) {
+        // Read from the queue, the instance buffer is write combined memory.
+        const auto &world = m_queue.m_transforms[m_queue.m_items[i].transform_index];
+        m_meshlet_culler.set_instance(m_curr_pass.frustum, m_curr_pass.camera_pos, world);
+
+        bool extend = false;
+        for (u32 m = prim.meshlet_index; m < prim.meshlet_index + prim.num_meshlets; ++m) {
+            const auto &meshlet = scene.m_meshlets[m];
+            bool visible =
+                m_meshlet_culler.frustum_visible(meshlet.sphere_center, meshlet.sphere_radius) &&
+                m_meshlet_culler.cone_visible(meshlet.sphere_center, meshlet.sphere_radius,
+                                              meshlet.cone_axis, meshlet.cone_cutoff);
+            m_meshlets_tested++;
+            if (!visible) {
+                extend = false;
+                continue;
+            }
+            m_meshlets_visible++;
+
+            // Meshlets are consecutive in the index buffer, a run of them is one range.
+            if (extend) {
+                commands.back().count += meshlet.num_triangles * 3;
+                continue;
+            }
+            commands.push_back({
+                .count = meshlet.num_triangles * 3,
+                .instance_count = 1,
+                .first_index = first_index + meshlet.index_offset,
+                .base_vertex = (i32)prim.base_vertex,
+                .base_instance = i,
+            });
+            extend = true;
+        }
     }
 }
 
@@ -230,13 +704,6 @@ void Renderer::create_ubos() {
         glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_ubo_matrices_handle);
     }
 
-    {
-        glCreateBuffers(1, &m_ubo_material_handle);
-        u32 size = sizeof(GPUMaterial) * 1;
-        glNamedBufferData(m_ubo_material_handle, size, nullptr, GL_DYNAMIC_DRAW);
-        glBindBufferBase(GL_UNIFORM_BUFFER, 1, m_ubo_material_handle);
-    }
-
     {
         glCreateBuffers(1, &m_ubo_light_positions);
         u32 size = sizeof(glm::vec4) * 5;
@@ -276,35 +743,59 @@ void Renderer::draw_skybox() {
     glBindTextureUnit(0, m_skybox.skybox_image.m_handle);
 
     // Remove translation from the view matrix.
-    auto view = glm::mat4(glm::mat3(m_curr_pass.view_matrix));
-    glNamedBufferSubData(m_ubo_matrices_handle, sizeof(glm::mat4), sizeof(glm::mat4), &view);
+    UBOMatrices matrices = {
+        .model = glm::mat4(1.0f),
+        .view = glm::mat4(glm::mat3(m_curr_pass.view_matrix)),
+        .projection = m_curr_pass.projection_matrix,
+    };
+    u32 offset = push_frame_data(&matrices, sizeof(UBOMatrices));
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, m_frame_data.m_backend.handle, offset,
+                      sizeof(UBOMatrices));
 
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glDepthFunc(GL_LESS);
 }
 
-void Renderer::draw_node(const NodeHierarchy &hierarchy, u32 node_index,
-                         const glm::mat4 &parent_transform) {
-    const auto &node = hierarchy.m_nodes[node_index];
-
-    auto T = glm::translate(glm::mat4(1.0f), node.translation);
-    auto R = glm::mat4_cast(node.rotation);
-    auto S = glm::scale(glm::mat4(1.0f), node.scale);
-    auto node_transform = T * R * S;
-    auto global_transform = parent_transform * node_transform;
-    if (node.kind == Node::Kind::mesh) {
-        draw_mesh(node.mesh_index, global_transform);
+// Expects the world transforms to be up to date, see NodeHierarchy::update_world_transforms.
+void Renderer::draw_hierarchy(const Scene &scene, const NodeHierarchy &hierarchy) {
+    const auto &world_matrices = hierarchy.m_transforms.m_world_matrices;
+
+    // Every primitive is culled on its own, a large mesh like Sponza is mostly off screen.
+    m_culler.clear();
+    m_cull_candidates.clear();
+    for (u32 slot = 0; slot < hierarchy.m_slot_nodes.size(); slot++) {
+        const auto &node = hierarchy.m_nodes[hierarchy.m_slot_nodes[slot]];
+        if (node.kind != Node::Kind::mesh) continue;
+
+        const auto &mesh = scene.m_meshes[node.mesh_index];
+        for (u32 i = 0; i < mesh.num_primitives; ++i) {
+            u32 primitive_index = mesh.primitive_index + i;
+            const auto &bounds = scene.m_primitives[primitive_index].bounds;
+            m_culler.push(bounds.aabb_min, bounds.aabb_max, world_matrices[slot]);
+            m_cull_candidates.push_back({.primitive_index = primitive_index, .slot = slot});
+        }
     }
 
-    for (size_t i = 0; i < node.children.size(); i++) {
-        draw_node(hierarchy, node.children[i], global_transform);
+    m_primitives_tested += m_culler.size();
+    m_primitives_visible += m_culler.cull(m_curr_pass.frustum, m_visible);
+
+    u32 last_slot = UINT32_MAX;
+    u32 transform_index = 0;
+    f32 view_depth = 0.0f;
+    for (u32 i = 0; i < m_cull_candidates.size(); ++i) {
+        if (!m_visible[i]) continue;
+
+        const auto &candidate = m_cull_candidates[i];
+        if (candidate.slot != last_slot) {
+            const auto &transform = world_matrices[candidate.slot];
+            view_depth = -(m_curr_pass.view_matrix * transform[3]).z;
+            transform_index = m_queue.push_transform(transform);
+            last_slot = candidate.slot;
+        }
+        record_primitive(scene, candidate.primitive_index, transform_index, view_depth);
     }
 }
 
-void Renderer::draw_hierarchy(const Scene &scene, const NodeHierarchy &hierarchy) {
-    draw_node(hierarchy, 0, glm::mat4(1.0f));
-}
-
 // clang-format off
 f32 skybox_vertices[] = {
     // positions          
@@ -2,11 +2,16 @@
 #define _RENDERER_H
 
 #include <glm/glm.hpp>
+#include <span>
+#include <vector>
 
 #include "Camera.h"
 #include "core.h"
+#include "graphics/Culling.h"
 #include "graphics/Image.h"
 #include "graphics/Pipeline.h"
+#include "graphics/RenderQueue.h"
+#include "graphics/RingBuffer.h"
 #include "graphics/Sampler.h"
 #include "scene/Node.h"
 #include "scene/Scene.h"
@@ -18,6 +23,14 @@ class Renderer {
     friend class Scene;
     typedef void *(*LoadProc)(const char *name);
 
+    enum class SubmissionMode : u32 {
+        // One instanced draw per group of items drawing the same primitive.
+        direct = 0,
+        // One glMultiDrawElementsIndirect per index type, materials are read from a table of
+        // bindless textures. Needs GL_ARB_bindless_texture.
+        indirect = 1,
+    };
+
     void init(LoadProc load_proc);
     void make_resources_for_scene(const loader::AssetFileData &scene);
 
@@ -28,12 +41,41 @@ class Renderer {
     void clear();
     void begin_pass(const Scene &scene, const Camera &camera, u32 width, u32 height);
     void end_pass();
+    // Records the primitives of the mesh, they are sorted and drawn in end_pass.
     void draw_mesh(u32 mesh_handle, const glm::mat4 &transform);
+    // Primitives outside of the view frustum are culled before they are recorded.
     void draw_hierarchy(const Scene &scene, const NodeHierarchy &hierarchy);
 
     // Temp
     void update_light_positions(u32 index, glm::vec4 pos);
 
+    // Draw calls issued for scene geometry during the last pass.
+    u32 get_draw_call_count() const { return m_draw_call_count; }
+    // Primitives frustum culled by draw_hierarchy during the last pass and how many of them were
+    // visible.
+    u32 get_primitives_tested() const { return m_primitives_tested; }
+    u32 get_primitives_visible() const { return m_primitives_visible; }
+
+    // Falls back to direct submission when indirect submission is not supported.
+    void set_submission_mode(SubmissionMode mode);
+    SubmissionMode get_submission_mode() const { return m_submission_mode; }
+    bool supports_indirect_submission() const { return m_bindless_supported; }
+
+    // Culls the meshlets of every drawn instance against the frustum and by their normal cones,
+    // and draws the remaining index ranges with a multi draw per primitive.
+    void set_meshlet_culling(bool enabled) { m_meshlet_culling = enabled; }
+    bool get_meshlet_culling() const { return m_meshlet_culling; }
+    // Meshlets tested during the last pass and how many of them were visible.
+    u32 get_meshlets_tested() const { return m_meshlets_tested; }
+    u32 get_meshlets_visible() const { return m_meshlets_visible; }
+
+    // Primitives are drawn at the coarsest level of detail whose error projects to at most this
+    // many pixels, 0 always draws the full primitives.
+    void set_lod_error_threshold(f32 pixels) { m_lod_error_threshold = pixels; }
+    f32 get_lod_error_threshold() const { return m_lod_error_threshold; }
+    // Primitives drawn at the level of detail during the last pass.
+    u32 get_lod_draw_count(u32 lod) const { return m_lod_draw_counts[lod]; }
+
    private:
     struct GeneratedImages {
         Image env_map;
@@ -44,6 +86,7 @@ class Renderer {
 
     u32 load_shader(const char *path, u32 shader_type);
     void create_textures(const Scene &scene);
+    void create_placeholder_images();
     void create_ubos();
 
     // Things we might want to move to a offline baking process.
@@ -63,20 +106,46 @@ class Renderer {
     void prefilter_env_map(const Image &env_map, Image &result);
     void draw_skybox();
     void create_skybox();
-    void draw_node(const NodeHierarchy &hierarchy, u32 node_index,
-                   const glm::mat4 &parent_transform);
+    // Binds the textures of the material, its parameters are read from the material table.
+    void bind_material(const Scene &scene, u32 material_index);
+    void create_material_parameters(std::span<const Material> materials);
+    void create_primitive_bounds(std::span<const Primitive> primitives);
+    // Picks the level of detail from the projected error of the primitive at its distance.
+    u32 select_lod(const Primitive &prim, const glm::mat4 &transform) const;
+    void record_primitive(const Scene &scene, u32 primitive_index, u32 transform_index,
+                          f32 view_depth);
+    void submit_queue();
+    void create_frame_data(u32 capacity);
+    // Makes sure allocations of size bytes in this frame can not fail, must be called before the
+    // first allocation of the frame.
+    void reserve_frame_data(u32 size);
+    u32 push_frame_data(const void *data, u32 size);
+    void create_material_table(const Scene &scene);
 
     bool m_scene_loaded;
     bool m_pass_in_progress;
 
     f32 m_max_texture_filtering;
     Sampler m_default_sampler;
+    // 1x1 images drawn in place of material textures that are not resident yet, one per texture
+    // slot of the material so they do not change its look: white, white, a flat normal, white and
+    // black.
+    Image m_placeholder_images[5];
 
     struct Pass {
         const Scene *scene;
         glm::mat4 projection_matrix;
         glm::mat4 view_matrix;
         glm::vec3 camera_pos;
+        Frustum frustum;
+        // Pixels covered by one unit at distance one from the camera, projection_matrix[1][1]
+        // times half the viewport height.
+        f32 lod_error_scale;
+    };
+
+    struct CullCandidate {
+        u32 primitive_index;
+        u32 slot;
     };
 
     struct Skybox {
@@ -90,18 +159,90 @@ class Renderer {
         glm::mat4 projection;
     };
 
+    // Material parameter table entry of the direct path, matches MaterialParameters in
+    // basic.frag.glsl (std430).
     struct GPUMaterial {
         glm::vec4 base_color_factor;
         glm::vec4 metallic_roughness_normal_occlusion;
-        glm::vec3 camera_pos;
+        glm::vec3 emissive_factor;
         u32 flags;
+    };
+
+    // Material table entry of the indirect path, matches Material in basic.frag.glsl (std430).
+    struct GPUBindlessMaterial {
+        glm::vec4 base_color_factor;
+        glm::vec4 metallic_roughness_normal_occlusion;
         glm::vec3 emissive_factor;
-        f32 pad;
+        u32 flags;
+        u64 textures[5];
+        u64 pad;
     };
 
+    // Dequantizes the positions of PackedVertex, matches PrimitiveBounds in basic.vert.glsl.
+    struct GPUPrimitiveBounds {
+        glm::vec4 aabb_min;
+        glm::vec4 aabb_extent;
+    };
+
+    // Written at the base instance of every instanced draw, read by the vertex shader.
+    struct InstanceDraw {
+        u32 material_index;
+        u32 primitive_index;
+    };
+
+    struct DrawElementsIndirectCommand {
+        u32 count;
+        u32 instance_count;
+        u32 first_index;
+        i32 base_vertex;
+        u32 base_instance;
+    };
+
+    // Appends a command for every run of consecutive visible meshlets of the instances first to
+    // last of the queue, which all draw prim.
+    void append_meshlet_commands(const Scene &scene, const Primitive &prim, u32 first, u32 last,
+                                 std::vector<DrawElementsIndirectCommand> &commands);
+
     Pass m_curr_pass;
+    RenderQueue m_queue;
+    // Everything written per frame: pass uniforms, instance matrices and InstanceDraws
+    // (bindings 3 and 4) and indirect commands. Bound with ranges, never re-uploaded.
+    RingBuffer<GLRingBackend> m_frame_data;
+    u32 m_frame_data_alignment;
+    u32 m_draw_call_count;
+    FrustumCuller m_culler;
+    std::vector<CullCandidate> m_cull_candidates;
+    std::vector<u8> m_visible;
+    u32 m_primitives_tested;
+    u32 m_primitives_visible;
+    bool m_meshlet_culling;
+    MeshletCuller m_meshlet_culler;
+    // Commands of the primitive being drawn by the direct path.
+    std::vector<DrawElementsIndirectCommand> m_meshlet_commands;
+    u32 m_meshlets_tested;
+    u32 m_meshlets_visible;
+    f32 m_lod_error_threshold;
+    u32 m_lod_draw_counts[max_primitive_lods];
+
+    SubmissionMode m_submission_mode;
+    bool m_bindless_supported;
+    // Indirect commands grouped by index type, GL_UNSIGNED_BYTE, SHORT and INT.
+    std::vector<DrawElementsIndirectCommand> m_indirect_commands[3];
+    // Bindless handles make their sampler immutable, so the table has its own copies of the
+    // scene samplers and is rebuilt when the texture filtering changes.
+    u32 m_material_table;
+    // Parameters of every material, uploaded once in make_resources_for_scene (binding 6).
+    u32 m_material_parameters;
+    // Position dequantization of every primitive, uploaded once (binding 7).
+    u32 m_primitive_bounds;
+    const Scene *m_material_table_scene;
+    // Resident images of the scene when the table was built, placeholders are replaced by
+    // rebuilding it.
+    u32 m_material_table_resident_images;
+    std::vector<Sampler> m_bindless_samplers;
+    std::vector<u64> m_bindless_handles;
+    f32 m_texture_filtering_level;
 
-    u32 m_ubo_material_handle;
     u32 m_ubo_matrices_handle;
     u32 m_ubo_light_positions;
 
@@ -109,6 +250,7 @@ class Renderer {
     GeneratedImages m_offline_images;
 
     Pipeline m_pbr_pipeline;
+    Pipeline m_pbr_indirect_pipeline;
 };
 
 }  // namespace engine
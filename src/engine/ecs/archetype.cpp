@@ -0,0 +1,207 @@
+#include "archetype.hpp"
+#include <cstdlib>
+#include <cstring>
+
+ArchetypeManager::ArchetypeManager() {
+    for (u32 i = 0; i < MAX_COMPONENTS; i++) {
+        component_infos[i] = { .size = 0, .alignment = 1 };
+    }
+    // Archetype 0 is the empty signature, new entities start there.
+    get_or_create_archetype(Signature());
+}
+
+ArchetypeManager::~ArchetypeManager() {
+    for (Archetype &archetype : archetypes) {
+        for (Chunk &chunk : archetype.chunks) {
+            std::free(chunk.memory);
+        }
+    }
+}
+
+static u32 align_up(u32 value, u32 alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+u32 ArchetypeManager::get_or_create_archetype(Signature signature) {
+    auto it = archetype_lookup.find(signature);
+    if (it != archetype_lookup.end()) {
+        return it->second;
+    }
+
+    Archetype archetype;
+    archetype.signature = signature;
+    u32 row_size = sizeof(Entity);
+    for (ComponentID id = 0; id < MAX_COMPONENTS; id++) {
+        if (!signature.test(id)) continue;
+        archetype.components.push_back(id);
+        row_size += component_infos[id].size + sizeof(ComponentTicks);
+    }
+
+    // Start from the unaligned estimate and shrink until the padded columns fit in a chunk.
+    u32 capacity = CHUNK_SIZE / row_size;
+    while (capacity > 0) {
+        u32 offset = align_up(sizeof(Entity) * capacity, CHUNK_ALIGNMENT);
+        archetype.column_offsets.clear();
+        archetype.tick_offsets.clear();
+        for (ComponentID id : archetype.components) {
+            offset = align_up(offset, std::max(component_infos[id].alignment, CHUNK_ALIGNMENT));
+            archetype.column_offsets.push_back(offset);
+            offset += component_infos[id].size * capacity;
+            offset = align_up(offset, CHUNK_ALIGNMENT);
+            archetype.tick_offsets.push_back(offset);
+            offset += sizeof(ComponentTicks) * capacity;
+        }
+        if (offset <= CHUNK_SIZE) break;
+        capacity--;
+    }
+
+    if (capacity == 0) {
+        ERROR("Archetype components do not fit in a single {} byte chunk", CHUNK_SIZE);
+        exit(1);
+    }
+    archetype.chunk_capacity = capacity;
+
+    if (!archetype.components.empty()) {
+        archetype.column_lookup.assign(archetype.components.back() + 1, INVALID_ARCHETYPE);
+    }
+    for (u32 i = 0; i < archetype.components.size(); i++) {
+        archetype.column_lookup[archetype.components[i]] = i;
+    }
+
+    u32 index = archetypes.size();
+    archetypes.push_back(std::move(archetype));
+    archetype_signatures.push_back(signature);
+    archetype_lookup[signature] = index;
+    return index;
+}
+
+EntityLocation ArchetypeManager::allocate_row(u32 archetype_index, Entity entity) {
+    Archetype &archetype = archetypes[archetype_index];
+    if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.chunk_capacity) {
+        Chunk chunk;
+        chunk.memory = (u8*)std::aligned_alloc(CHUNK_ALIGNMENT, CHUNK_SIZE);
+        chunk.count = 0;
+        archetype.chunks.push_back(chunk);
+    }
+
+    u32 chunk_index = archetype.chunks.size() - 1;
+    Chunk &chunk = archetype.chunks[chunk_index];
+    u32 row = chunk.count++;
+    archetype.chunk_entities(chunk)[row] = entity;
+
+    EntityLocation location = { .archetype = archetype_index, .chunk = chunk_index, .row = row };
+    locations[entity_index(entity)] = location;
+    return location;
+}
+
+// Fills the hole with the last entity of the archetype so that all chunks but the last stay full.
+void ArchetypeManager::remove_row(EntityLocation location) {
+    Archetype &archetype = archetypes[location.archetype];
+    Chunk &chunk = archetype.chunks[location.chunk];
+    Chunk &last_chunk = archetype.chunks.back();
+    u32 last_row = last_chunk.count - 1;
+
+    if (&chunk != &last_chunk || location.row != last_row) {
+        Entity moved = archetype.chunk_entities(last_chunk)[last_row];
+        archetype.chunk_entities(chunk)[location.row] = moved;
+        for (u32 i = 0; i < archetype.components.size(); i++) {
+            u32 size = component_infos[archetype.components[i]].size;
+            std::memcpy(archetype.column(chunk, i) + size * location.row,
+                        archetype.column(last_chunk, i) + size * last_row, size);
+            archetype.ticks(chunk, i)[location.row] = archetype.ticks(last_chunk, i)[last_row];
+        }
+        locations[entity_index(moved)] = location;
+    }
+
+    last_chunk.count--;
+    if (last_chunk.count == 0) {
+        std::free(last_chunk.memory);
+        archetype.chunks.pop_back();
+    }
+}
+
+void ArchetypeManager::create_entity(Entity entity) {
+    u32 index = entity_index(entity);
+    if (index >= locations.size()) {
+        locations.resize(index + 1, { .archetype = INVALID_ARCHETYPE });
+    }
+    allocate_row(0, entity);
+}
+
+void ArchetypeManager::destroy_entity(Entity entity) {
+    u32 index = entity_index(entity);
+    if (index >= locations.size() || locations[index].archetype == INVALID_ARCHETYPE) return;
+    remove_row(locations[index]);
+    locations[index].archetype = INVALID_ARCHETYPE;
+}
+
+void ArchetypeManager::set_signature(Entity entity, Signature signature, u32 tick) {
+    EntityLocation old_location = locations[entity_index(entity)];
+    u32 target = get_or_create_archetype(signature);
+    if (target == old_location.archetype) return;
+
+    EntityLocation new_location = allocate_row(target, entity);
+
+    // Copy the columns both archetypes share, new columns are left uninitialized but count as
+    // added at `tick`.
+    Archetype &from = archetypes[old_location.archetype];
+    Archetype &to = archetypes[target];
+    Chunk &from_chunk = from.chunks[old_location.chunk];
+    Chunk &to_chunk = to.chunks[new_location.chunk];
+    for (u32 i = 0; i < to.components.size(); i++) {
+        to.ticks(to_chunk, i)[new_location.row] = { .added = tick, .changed = tick };
+    }
+    for (u32 i = 0; i < from.components.size(); i++) {
+        u32 to_column = to.column_of(from.components[i]);
+        if (to_column == INVALID_ARCHETYPE) continue;
+        u32 size = component_infos[from.components[i]].size;
+        std::memcpy(to.column(to_chunk, to_column) + size * new_location.row,
+                    from.column(from_chunk, i) + size * old_location.row, size);
+        to.ticks(to_chunk, to_column)[new_location.row] = from.ticks(from_chunk, i)[old_location.row];
+    }
+
+    remove_row(old_location);
+}
+
+void ArchetypeManager::update_query(Query &query) {
+    u32 unchecked = archetypes.size() - query.archetypes_checked;
+    if (unchecked == 0) return;
+
+    // Local so that systems running in parallel can refresh their queries at the same time.
+    std::vector<u32> matches(unchecked);
+    u32 match_count = match_signatures(&archetype_signatures[query.archetypes_checked], unchecked,
+                                       query.get_signature(), matches.data());
+    for (u32 i = 0; i < match_count; i++) {
+        query.archetypes.push_back(query.archetypes_checked + matches[i]);
+    }
+    query.archetypes_checked = archetypes.size();
+}
+
+void ArchetypeManager::split_query(Query &query, u32 grain, std::vector<ChunkRange> &ranges) {
+    update_query(query);
+    for (u32 archetype_index : query.archetypes) {
+        Archetype &archetype = archetypes[archetype_index];
+        ChunkRange range = { .archetype = archetype_index, .first_chunk = 0, .chunk_count = 0 };
+        u32 range_size = 0;
+        for (u32 i = 0; i < archetype.chunks.size(); i++) {
+            range.chunk_count++;
+            range_size += archetype.chunks[i].count;
+            if (range_size >= grain) {
+                ranges.push_back(range);
+                range = { .archetype = archetype_index, .first_chunk = i + 1, .chunk_count = 0 };
+                range_size = 0;
+            }
+        }
+        if (range.chunk_count > 0) {
+            ranges.push_back(range);
+        }
+    }
+}
+
+void ArchetypeManager::get_filter_columns(Archetype &archetype, const QueryFilter &query_filter, FilterColumns &filter) {
+    for (u32 i = 0; i < archetype.components.size(); i++) {
+        ComponentID id = archetype.components[i];
+        if (query_filter.changed.test(id)) filter.changed.push_back(i);
+        if (query_filter.added.test(id)) filter.added.push_back(i);
+    }
+}
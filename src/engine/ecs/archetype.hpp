@@ -0,0 +1,203 @@
+#pragma once
+
+#include "engine/utils/logging.h"
+#include "types.h"
+#include "component.hpp"
+#include "entity.hpp"
+#include "query.hpp"
+#include "signature.hpp"
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+const u32 CHUNK_SIZE = 16 * 1024;
+const u32 CHUNK_ALIGNMENT = 64;
+const u32 INVALID_ARCHETYPE = UINT32_MAX;
+
+struct ComponentInfo {
+    u32 size;
+    u32 alignment;
+};
+
+// A fixed size block of memory holding `count` entities of one archetype. The entity ids come
+// first followed by one tightly packed column per component (struct of arrays).
+struct Chunk {
+    u8 *memory;
+    u32 count;
+};
+
+struct Archetype {
+    Signature signature;
+    std::vector<ComponentID> components;
+    // Byte offset of every component column inside a chunk, same order as `components`.
+    std::vector<u32> column_offsets;
+    // Byte offset of the ComponentTicks column that follows every component column.
+    std::vector<u32> tick_offsets;
+    // Maps a component id to its index in `components`, INVALID_ARCHETYPE if not present.
+    std::vector<u32> column_lookup;
+    u32 chunk_capacity;
+    std::vector<Chunk> chunks;
+
+    u32 column_of(ComponentID component_id) {
+        if (component_id >= column_lookup.size()) return INVALID_ARCHETYPE;
+        return column_lookup[component_id];
+    }
+
+    Entity *chunk_entities(Chunk &chunk) {
+        return (Entity*)chunk.memory;
+    }
+
+    u8 *column(Chunk &chunk, u32 column_index) {
+        return chunk.memory + column_offsets[column_index];
+    }
+
+    ComponentTicks *ticks(Chunk &chunk, u32 column_index) {
+        return (ComponentTicks*)(chunk.memory + tick_offsets[column_index]);
+    }
+};
+
+// Tick columns tested by a filtered query in one archetype.
+struct FilterColumns {
+    std::vector<u32> changed;
+    std::vector<u32> added;
+};
+
+struct EntityLocation {
+    u32 archetype;
+    u32 chunk;
+    u32 row;
+};
+
+// Consecutive chunks of one archetype, the unit of work of a parallel query.
+struct ChunkRange {
+    u32 archetype;
+    u32 first_chunk;
+    u32 chunk_count;
+};
+
+// Archetype storage backend. Entities with the same signature share chunks and moving an
+// entity between archetypes copies the shared columns. Components must be trivially
+// copyable since they are moved around with memcpy.
+class ArchetypeManager {
+    public:
+        ArchetypeManager();
+
+        ~ArchetypeManager();
+
+        template <typename T>
+        void register_component() {
+            static_assert(std::is_trivially_copyable_v<T>, "Archetype components must be trivially copyable");
+            const u32 component_id = T::get_id();
+            component_infos[component_id] = { .size = sizeof(T), .alignment = alignof(T) };
+        }
+
+        void create_entity(Entity entity);
+
+        void destroy_entity(Entity entity);
+
+        // Moves the entity to the archetype matching the signature. The ticks of the components
+        // it did not have before are set to `tick`.
+        void set_signature(Entity entity, Signature signature, u32 tick);
+
+        // Does not touch the ticks, writers go through ECS::get_component or mark_changed.
+        template <typename T>
+        T& get_component(Entity entity) {
+            EntityLocation &location = locations[entity_index(entity)];
+            Archetype &archetype = archetypes[location.archetype];
+            Chunk &chunk = archetype.chunks[location.chunk];
+            T *column = (T*)archetype.column(chunk, archetype.column_of(T::get_id()));
+            return column[location.row];
+        }
+
+        ComponentTicks &get_ticks(Entity entity, ComponentID component_id) {
+            EntityLocation &location = locations[entity_index(entity)];
+            Archetype &archetype = archetypes[location.archetype];
+            Chunk &chunk = archetype.chunks[location.chunk];
+            return archetype.ticks(chunk, archetype.column_of(component_id))[location.row];
+        }
+
+        void mark_changed(Entity entity, ComponentID component_id, u32 tick) {
+            get_ticks(entity, component_id).changed = tick;
+        }
+
+        // Appends the archetypes created since the last call that match the query.
+        void update_query(Query &query);
+
+        // Streams over the packed columns of every archetype matching the query. Components
+        // that are not const in Ts are marked as changed at `tick`.
+        template <typename... Ts, typename Fn>
+        void for_each(Query &query, u32 tick, Fn fn) {
+            update_query(query);
+            for (u32 archetype_index : query.archetypes) {
+                ChunkRange range = {
+                    .archetype = archetype_index,
+                    .first_chunk = 0,
+                    .chunk_count = (u32)archetypes[archetype_index].chunks.size(),
+                };
+                for_each_in_range<Ts...>(query, range, tick, fn);
+            }
+        }
+
+        // Splits the matching archetypes into ranges of whole chunks holding at least `grain`
+        // entities each, except for the last range of every archetype.
+        void split_query(Query &query, u32 grain, std::vector<ChunkRange> &ranges);
+
+        template <typename... Ts, typename Fn>
+        void for_each_in_range(const Query &query, const ChunkRange &range, u32 tick, Fn &fn) {
+            Archetype &archetype = archetypes[range.archetype];
+            u32 columns[] = { archetype.column_of(Ts::get_id())... };
+            FilterColumns filter;
+            if (!query.filter.is_empty()) {
+                get_filter_columns(archetype, query.filter, filter);
+            }
+            for (u32 i = 0; i < range.chunk_count; i++) {
+                Chunk &chunk = archetype.chunks[range.first_chunk + i];
+                for_each_row<Ts...>(archetype, chunk, columns, filter, query.last_run_tick, tick, fn,
+                                    std::index_sequence_for<Ts...>());
+            }
+        }
+
+        u32 archetype_count() {
+            return archetypes.size();
+        }
+    private:
+        ComponentInfo component_infos[MAX_COMPONENTS];
+        std::vector<Archetype> archetypes;
+        // Signature of every archetype, kept packed for the batch matcher.
+        std::vector<Signature> archetype_signatures;
+        std::unordered_map<Signature, u32> archetype_lookup;
+        std::vector<EntityLocation> locations;
+
+        u32 get_or_create_archetype(Signature signature);
+
+        EntityLocation allocate_row(u32 archetype_index, Entity entity);
+
+        void remove_row(EntityLocation location);
+
+        void get_filter_columns(Archetype &archetype, const QueryFilter &query_filter, FilterColumns &filter);
+
+        static bool passes_filter(Archetype &archetype, Chunk &chunk, const FilterColumns &filter, u32 row, u32 since) {
+            for (u32 column : filter.changed) {
+                if (!archetype.ticks(chunk, column)[row].is_changed(since)) return false;
+            }
+            for (u32 column : filter.added) {
+                if (!archetype.ticks(chunk, column)[row].is_added(since)) return false;
+            }
+            return true;
+        }
+
+        template <typename... Ts, typename Fn, size_t... Is>
+        void for_each_row(Archetype &archetype, Chunk &chunk, const u32 *columns, const FilterColumns &filter,
+                          u32 since, u32 tick, Fn &fn, std::index_sequence<Is...>) {
+            std::tuple<Ts*...> pointers = { (Ts*)archetype.column(chunk, columns[Is])... };
+            ComponentTicks *ticks[] = { archetype.ticks(chunk, columns[Is])... };
+            bool filtered = !filter.changed.empty() || !filter.added.empty();
+            for (u32 row = 0; row < chunk.count; row++) {
+                if (filtered && !passes_filter(archetype, chunk, filter, row, since)) continue;
+                fn(std::get<Is>(pointers)[row]...);
+                ((std::is_const_v<Ts> ? void() : void(ticks[Is][row].changed = tick)), ...);
+            }
+        }
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "types.h"
+#include "component.hpp"
+#include "entity.hpp"
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+enum class CommandType : u8 {
+    create_entity,
+    destroy_entity,
+    add_component,
+    remove_component,
+};
+
+struct Command {
+    Entity entity;
+    CommandType type;
+    ComponentID component_id;
+    // Offset of the component in the payload of the buffer, only used by add_component.
+    u32 payload_offset;
+};
+
+// Records structural changes so that they can be made while systems are iterating queries,
+// possibly on several threads. Every job pool thread has its own buffer, see
+// ECS::get_command_buffer, and ECS::flush applies all of them at once.
+class CommandBuffer {
+    public:
+        CommandBuffer(EntityManager *entity_manager) {
+            this->entity_manager = entity_manager;
+        }
+
+        // The returned handle can be stored right away, the entity is created by the flush.
+        Entity create_entity() {
+            Entity entity = entity_manager->reserve_entity();
+            commands.push_back({ .entity = entity, .type = CommandType::create_entity });
+            return entity;
+        }
+
+        void destroy_entity(Entity entity) {
+            commands.push_back({ .entity = entity, .type = CommandType::destroy_entity });
+        }
+
+        template <typename T>
+        void add_component(Entity entity, T component) {
+            static_assert(std::is_trivially_copyable_v<T>, "Deferred components must be trivially copyable");
+            static_assert(alignof(T) <= alignof(std::max_align_t), "Deferred components can not be over aligned");
+            // The payload comes from operator new so aligning the offset aligns the component.
+            u32 offset = (payload.size() + alignof(T) - 1) & ~(alignof(T) - 1);
+            payload.resize(offset + sizeof(T));
+            std::memcpy(payload.data() + offset, &component, sizeof(T));
+            commands.push_back({
+                .entity = entity,
+                .type = CommandType::add_component,
+                .component_id = T::get_id(),
+                .payload_offset = offset,
+            });
+        }
+
+        template <typename T>
+        void remove_component(Entity entity) {
+            commands.push_back({
+                .entity = entity,
+                .type = CommandType::remove_component,
+                .component_id = T::get_id(),
+            });
+        }
+
+        std::vector<Command> &get_commands() {
+            return commands;
+        }
+
+        const u8 *get_payload(const Command &command) {
+            return payload.data() + command.payload_offset;
+        }
+
+        bool is_empty() {
+            return commands.empty();
+        }
+
+        void clear() {
+            commands.clear();
+            payload.clear();
+        }
+    private:
+        EntityManager *entity_manager;
+        std::vector<Command> commands;
+        std::vector<u8> payload;
+};
@@ -3,6 +3,10 @@
 #include "engine/utils/logging.h"
 #include "types.h"
 #include "entity.hpp"
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
 
 using ComponentID = u32;
 
@@ -30,36 +34,146 @@ class Component : public ComponentBase {
         }
 };
 
+// Ticks of the ECS change counter when a component was added and when it was last written,
+// see ECS::get_change_tick.
+struct ComponentTicks {
+    u32 added;
+    u32 changed;
+
+    bool is_added(u32 since) const {
+        return added > since;
+    }
+
+    bool is_changed(u32 since) const {
+        return changed > since;
+    }
+};
+
+const u32 INVALID_COMPONENT_INDEX = UINT32_MAX;
+const u32 SPARSE_PAGE_SIZE = 4096;
+
+// Sparse set of components. The components are packed in `data` and `entities` holds the
+// owner of every packed slot, so iterating the array is a linear scan without holes. The
+// sparse map from entity to packed index is paged so that it only costs memory for the
+// id ranges that actually have the component. Everything but the component data lives in the
+// base class so that filters can read the ticks without knowing the component type.
 class IComponentArray {
     public:
         virtual ~IComponentArray() = default;
         virtual void destroy_entity(Entity entity) = 0;
+
+        bool has_component(Entity entity) {
+            u32 index = entity_index(entity);
+            u32 page = index / SPARSE_PAGE_SIZE;
+            if (page >= sparse.size() || sparse[page] == nullptr) return false;
+            u32 packed = sparse[page][index % SPARSE_PAGE_SIZE];
+            // Comparing the full handle rejects stale entities whose index was recycled.
+            return packed != INVALID_COMPONENT_INDEX && entities[packed] == entity;
+        }
+
+        // The entity must have the component. Unlike sparse_index this never allocates a page,
+        // so it is safe to call from several threads at once.
+        u32 packed_index(Entity entity) {
+            assert(has_component(entity));
+            u32 index = entity_index(entity);
+            return sparse[index / SPARSE_PAGE_SIZE][index % SPARSE_PAGE_SIZE];
+        }
+
+        ComponentTicks &get_ticks(Entity entity) {
+            return ticks[packed_index(entity)];
+        }
+
+        ComponentTicks ticks_at(u32 index) {
+            return ticks[index];
+        }
+
+        void mark_changed(Entity entity, u32 tick) {
+            ticks[packed_index(entity)].changed = tick;
+        }
+
+        u32 size() {
+            return entities.size();
+        }
+
+        Entity entity_at(u32 index) {
+            return entities[index];
+        }
+    protected:
+        std::vector<Entity> entities;
+        std::vector<ComponentTicks> ticks;
+        std::vector<std::unique_ptr<u32[]>> sparse;
+
+        u32& sparse_index(Entity entity) {
+            u32 index = entity_index(entity);
+            u32 page = index / SPARSE_PAGE_SIZE;
+            if (page >= sparse.size()) {
+                sparse.resize(page + 1);
+            }
+            if (sparse[page] == nullptr) {
+                sparse[page] = std::make_unique<u32[]>(SPARSE_PAGE_SIZE);
+                std::fill_n(sparse[page].get(), SPARSE_PAGE_SIZE, INVALID_COMPONENT_INDEX);
+            }
+            return sparse[page][index % SPARSE_PAGE_SIZE];
+        }
 };
 
 template <typename T>
-class ComponentArray {
+class ComponentArray : public IComponentArray {
     public:
-        ComponentArray(): data() {
-            for (u32 i = 0; i < MAX_ENTITIES; i++) {
-                data[i] = T();
-            }
+        ComponentArray() {
         }
 
+        // Does not touch the ticks, writers go through ECS::get_component or mark_changed.
         T& get_component(Entity entity) {
-            T& c = (T&)data[entity];
-            return c;
+            return data[packed_index(entity)];
+        }
+
+        void set_component(Entity entity, T component, u32 tick) {
+            if (has_component(entity)) {
+                u32 idx = sparse_index(entity);
+                data[idx] = component;
+                ticks[idx].changed = tick;
+                return;
+            }
+
+            sparse_index(entity) = data.size();
+            data.push_back(component);
+            entities.push_back(entity);
+            ticks.push_back({ .added = tick, .changed = tick });
         }
 
-        void set_component(Entity entity, T component) {
-            data[entity] = component;
+        // Swap-remove, the last component is moved into the hole.
+        void remove_component(Entity entity) {
+            if (!has_component(entity)) return;
+
+            u32 idx = sparse_index(entity);
+            u32 last = data.size() - 1;
+            if (idx != last) {
+                data[idx] = data[last];
+                entities[idx] = entities[last];
+                ticks[idx] = ticks[last];
+                sparse_index(entities[idx]) = idx;
+            }
+            data.pop_back();
+            entities.pop_back();
+            ticks.pop_back();
+            sparse_index(entity) = INVALID_COMPONENT_INDEX;
         }
 
-        void destroy_entity(Entity entity) {
-            data[entity] = T();
+        void destroy_entity(Entity entity) override {
+            remove_component(entity);
+        }
+
+        T *begin() {
+            return data.data();
+        }
+
+        T *end() {
+            return data.data() + data.size();
         }
 
     private:
-        T data[MAX_ENTITIES];
+        std::vector<T> data;
 };
 
 class ComponentManager {
@@ -72,7 +186,7 @@ class ComponentManager {
         }
 
         ~ComponentManager() {
-            for (u32 i = 0; i < component_count; i++) {
+            for (u32 i = 0; i < MAX_COMPONENTS; i++) {
                 delete component_arrays[i];
             }
         }
@@ -80,15 +194,13 @@ class ComponentManager {
         template <typename T>
             void register_component() {
                 const u32 component_id = T::get_id();
-                ComponentArray<ComponentBase> *component_array = (ComponentArray<ComponentBase>*) new ComponentArray<T>();
-                component_arrays[component_id] = component_array;
+                component_arrays[component_id] = new ComponentArray<T>();
                 component_count++;
             }
 
         template <typename T>
-            void add_component(Entity entity, T component) {
-                const u32 component_id = T::get_id();
-                get_component_array<T>()->set_component(entity, component);
+            void add_component(Entity entity, T component, u32 tick) {
+                get_component_array<T>()->set_component(entity, component, tick);
             }
 
         template <typename T>
@@ -98,9 +210,14 @@ class ComponentManager {
                 return component;
             }
 
+        template <typename T>
+            bool has_component(Entity entity) {
+                return get_component_array<T>()->has_component(entity);
+            }
+
         template <typename T>
             void remove_component(Entity entity) {
-                get_component_array<T>()->set_component(entity, T());
+                get_component_array<T>()->remove_component(entity);
             }
 
         template <typename T>
@@ -108,18 +225,24 @@ class ComponentManager {
                 return T::get_id();
             }
 
+        template <typename T>
+            ComponentArray<T> *get_component_array() {
+                const u32 component_id = T::get_id();
+                return static_cast<ComponentArray<T>*>(component_arrays[component_id]);
+            }
+
+        IComponentArray *get_component_array(ComponentID component_id) {
+            return component_arrays[component_id];
+        }
+
         void destroy_entity(Entity entity) {
-            for (u32 i = 0; i < component_count; i++) {
-                component_arrays[i]->destroy_entity(entity);
+            for (u32 i = 0; i < MAX_COMPONENTS; i++) {
+                if (component_arrays[i] != nullptr) {
+                    component_arrays[i]->destroy_entity(entity);
+                }
             }
         }
     private:
-        ComponentArray<ComponentBase> *component_arrays[MAX_COMPONENTS];
+        IComponentArray *component_arrays[MAX_COMPONENTS];
         u32 component_count;
-
-        template <typename T>
-            ComponentArray<T> *get_component_array() {
-                const u32 component_id = T::get_id();
-                return (ComponentArray<T>*)component_arrays[component_id];
-            }
 };
@@ -1,23 +1,199 @@
 #include "ecs.hpp"
 #include "engine/ecs/resource.hpp"
+#include <algorithm>
 
-ECS::ECS() {
+ECS::ECS(StorageMode storage_mode, u32 thread_count) {
+    this->storage_mode = storage_mode;
+    change_tick = 1;
+    job_pool = new JobPool(thread_count);
     entity_manager = new EntityManager();
     component_manager = new ComponentManager();
-    system_manager = new SystemManager();
+    archetype_manager = new ArchetypeManager();
+    system_manager = new SystemManager(job_pool);
     resource_manager = new ResourceManager();
+    for (u32 i = 0; i < job_pool->get_thread_count(); i++) {
+        command_buffers.emplace_back(entity_manager);
+    }
+}
+
+ECS::~ECS() {
+    delete system_manager;
+    delete resource_manager;
+    delete archetype_manager;
+    delete component_manager;
+    delete entity_manager;
+    // Joins the worker threads.
+    delete job_pool;
 }
 
 Entity ECS::create_entity() {
     Entity e = entity_manager->create_entity();
-    Signature signature = entity_manager->get_signature(e);
-    system_manager->update_components(e, signature);
+    entity_manager->set_signature(e, Signature());
+    if (storage_mode == StorageMode::archetype) {
+        archetype_manager->create_entity(e);
+    }
+    system_manager->create_entity(e);
     return e;
 }
 
 void ECS::destroy_entity(Entity entity) {
+    // Destroying a stale handle would remove whoever reuses its index.
+    if (!entity_manager->is_alive(entity)) return;
+
+    if (storage_mode == StorageMode::archetype) {
+        archetype_manager->destroy_entity(entity);
+    } else {
+        component_manager->destroy_entity(entity);
+    }
+    system_manager->destroy_entity(entity, entity_manager->get_signature(entity));
     entity_manager->destroy_entity(entity);
-    component_manager->destroy_entity(entity);
-    system_manager->destroy_entity(entity);
 }
 
+bool ECS::is_alive(Entity entity) {
+    return entity_manager->is_alive(entity);
+}
+
+void ECS::update() {
+    system_manager->update(*this);
+    flush();
+}
+
+void ECS::flush() {
+    flush_commands.clear();
+    u32 command_count = 0;
+    for (CommandBuffer &buffer : command_buffers) {
+        command_count += buffer.get_commands().size();
+    }
+    flush_commands.reserve(command_count);
+    for (CommandBuffer &buffer : command_buffers) {
+        for (const Command &command : buffer.get_commands()) {
+            flush_commands.push_back({ .command = command, .payload = buffer.get_payload(command) });
+        }
+    }
+    if (flush_commands.empty()) return;
+
+    // Stable so the commands of every entity keep the order they were recorded in. Spawning
+    // fresh entities records them in order already so the sort is usually skipped.
+    auto by_entity = [](const FlushCommand &a, const FlushCommand &b) {
+        return a.command.entity < b.command.entity;
+    };
+    if (!std::is_sorted(flush_commands.begin(), flush_commands.end(), by_entity)) {
+        std::stable_sort(flush_commands.begin(), flush_commands.end(), by_entity);
+    }
+
+    flush_destroyed.clear();
+    u32 begin = 0;
+    while (begin < flush_commands.size()) {
+        Entity entity = flush_commands[begin].command.entity;
+        u32 end = begin + 1;
+        while (end < flush_commands.size() && flush_commands[end].command.entity == entity) end++;
+        apply_commands(entity, &flush_commands[begin], end - begin);
+        begin = end;
+    }
+
+    // Destroyed last, every other command of these entities has been skipped.
+    for (Entity entity : flush_destroyed) {
+        destroy_entity(entity);
+    }
+
+    for (CommandBuffer &buffer : command_buffers) {
+        buffer.clear();
+    }
+}
+
+void ECS::apply_commands(Entity entity, const FlushCommand *commands, u32 count) {
+    bool created = false;
+    bool destroyed = false;
+    for (u32 i = 0; i < count; i++) {
+        created |= commands[i].command.type == CommandType::create_entity;
+        destroyed |= commands[i].command.type == CommandType::destroy_entity;
+    }
+
+    if (created) {
+        entity_manager->activate_entity(entity);
+        if (storage_mode == StorageMode::archetype) {
+            archetype_manager->create_entity(entity);
+        }
+        system_manager->create_entity(entity);
+    }
+    // Commands recorded for an entity that has been destroyed in the meantime.
+    if (!entity_manager->is_alive(entity)) return;
+    if (destroyed) {
+        flush_destroyed.push_back(entity);
+        return;
+    }
+
+    Signature signature = entity_manager->get_signature(entity);
+    Signature new_signature = signature;
+    for (u32 i = 0; i < count; i++) {
+        const Command &command = commands[i].command;
+        if (command.type == CommandType::add_component) {
+            new_signature.set(command.component_id);
+        } else if (command.type == CommandType::remove_component) {
+            new_signature.reset(command.component_id);
+        }
+    }
+
+    if (storage_mode == StorageMode::archetype) {
+        // A single move to the final archetype, then the added components are written in order.
+        u32 tick = get_change_tick();
+        archetype_manager->set_signature(entity, new_signature, tick);
+        Signature removed;
+        for (u32 i = 0; i < count; i++) {
+            const Command &command = commands[i].command;
+            if (command.type == CommandType::remove_component) {
+                removed.set(command.component_id);
+            } else if (command.type == CommandType::add_component && new_signature.test(command.component_id)) {
+                component_ops[command.component_id].store(*this, entity, commands[i].payload);
+                // Removed and added again, the archetype did not change but the component is
+                // new, like in the sparse set storage.
+                if (removed.test(command.component_id)) {
+                    archetype_manager->get_ticks(entity, command.component_id) = { .added = tick, .changed = tick };
+                }
+            }
+        }
+    } else {
+        for (u32 i = 0; i < count; i++) {
+            const Command &command = commands[i].command;
+            if (command.type == CommandType::add_component) {
+                component_ops[command.component_id].store(*this, entity, commands[i].payload);
+            } else if (command.type == CommandType::remove_component) {
+                component_ops[command.component_id].erase(*this, entity);
+            }
+        }
+    }
+
+    entity_manager->set_signature(entity, new_signature);
+    if (signature != new_signature) {
+        system_manager->update_components(entity, signature, new_signature);
+    }
+}
+
+void ECS::run_jobs(void (*function)(void *context, u32 index), void *context, u32 job_count) {
+    // A single job is not worth the round trip through the pool.
+    if (job_count == 1) {
+        function(context, 0);
+        return;
+    }
+
+    std::atomic<u32> counter = job_count;
+    for (u32 i = 0; i < job_count; i++) {
+        job_pool->push({ function, context, i, &counter });
+    }
+    job_pool->wait(counter);
+}
+
+ComponentID ECS::filter_driver(Query &query) {
+    Signature filtered = query.filter.changed | query.filter.added;
+    ComponentID driver = 0;
+    u32 driver_size = UINT32_MAX;
+    for (ComponentID id = 0; id < MAX_COMPONENTS; id++) {
+        if (!filtered.test(id)) continue;
+        u32 size = component_manager->get_component_array(id)->size();
+        if (size < driver_size) {
+            driver = id;
+            driver_size = size;
+        }
+    }
+    return driver;
+}
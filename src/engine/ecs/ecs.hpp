@@ -4,67 +4,438 @@
 #include "types.h"
 #include "entity.hpp"
 #include "component.hpp"
+#include "archetype.hpp"
+#include "commandbuffer.hpp"
+#include "jobpool.hpp"
 #include "systemmanager.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+enum class StorageMode {
+    // One sparse set per component type.
+    sparse_set,
+    // Entities with the same signature share struct of arrays chunks.
+    archetype,
+};
 
 class ECS {
     public:
-        ECS();
+        // Threads running the systems, 0 uses every hardware thread and 1 runs them serially.
+        ECS(StorageMode storage_mode = StorageMode::sparse_set, u32 thread_count = 0);
+
+        ~ECS();
 
         Entity create_entity();
 
         void destroy_entity(Entity entity);
 
+        // False once the entity has been destroyed, even if its index has been reused.
+        bool is_alive(Entity entity);
+
         template <typename T>
         void register_component() {
-            component_manager->register_component<T>();
+            if (storage_mode == StorageMode::archetype) {
+                archetype_manager->register_component<T>();
+            } else {
+                component_manager->register_component<T>();
+            }
+            component_ops[T::get_id()] = { .store = store_component<T>, .erase = erase_component<T> };
         }
 
         template <typename T>
         void add_component(Entity entity, T component) {
-            component_manager->add_component(entity, component);
+            add_components(entity, component);
+        }
+
+        // Adds several components at once, the signature and the queries are only updated for
+        // the final set of components.
+        template <typename... Ts>
+        void add_components(Entity entity, Ts... components) {
+            // The page holding the signature of a stale handle may have been released.
+            if (!entity_manager->is_alive(entity)) return;
             Signature signature = entity_manager->get_signature(entity);
-            Signature new_signature = set_signature(signature, component_manager->get_component_id<T>());
+            Signature new_signature = signature;
+            (new_signature.set(component_manager->get_component_id<Ts>()), ...);
+            u32 tick = get_change_tick();
+            if (storage_mode == StorageMode::archetype) {
+                archetype_manager->set_signature(entity, new_signature, tick);
+                ((archetype_manager->get_component<Ts>(entity) = components), ...);
+                (archetype_manager->mark_changed(entity, Ts::get_id(), tick), ...);
+            } else {
+                (component_manager->add_component(entity, components, tick), ...);
+            }
             entity_manager->set_signature(entity, new_signature);
-            system_manager->update_components(entity, new_signature);
+            system_manager->update_components(entity, signature, new_signature);
         }
 
         template <typename T>
         void remove_component(Entity entity) {
-            component_manager->remove_component<T>(entity);
+            if (!entity_manager->is_alive(entity)) return;
             Signature signature = entity_manager->get_signature(entity);
             Signature new_signature = remove_signature(signature, component_manager->get_component_id<T>());
+            if (storage_mode == StorageMode::archetype) {
+                archetype_manager->set_signature(entity, new_signature, get_change_tick());
+            } else {
+                component_manager->remove_component<T>(entity);
+            }
             entity_manager->set_signature(entity, new_signature);
-            system_manager->update_components(entity, new_signature);
+            system_manager->update_components(entity, signature, new_signature);
         }
 
+        // Mutable access marks the component as changed, use read_component to only read it.
         template <typename T>
         T& get_component(Entity entity) {
-            return component_manager->get_component<T>(entity);
+            mark_changed<T>(entity);
+            return get_component_unmarked<T>(entity);
+        }
+
+        template <typename T>
+        const T& read_component(Entity entity) {
+            return get_component_unmarked<T>(entity);
+        }
+
+        template <typename T>
+        void mark_changed(Entity entity) {
+            if (storage_mode == StorageMode::archetype) {
+                archetype_manager->mark_changed(entity, T::get_id(), get_change_tick());
+            } else {
+                component_manager->get_component_array<T>()->mark_changed(entity, get_change_tick());
+            }
+        }
+
+        template <typename T>
+        ComponentTicks get_ticks(Entity entity) {
+            if (storage_mode == StorageMode::archetype) {
+                return archetype_manager->get_ticks(entity, T::get_id());
+            }
+            return component_manager->get_component_array<T>()->get_ticks(entity);
+        }
+
+        // Current value of the change counter, component writes are stamped with it. It is
+        // advanced every time a system finishes so that the system can tell its own writes
+        // from the ones made after it ran.
+        u32 get_change_tick() {
+            return change_tick.load(std::memory_order_relaxed);
+        }
+
+        // Returns the tick before advancing it.
+        u32 advance_change_tick() {
+            return change_tick.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        template <typename T>
+        bool has_component(Entity entity) {
+            return entity_manager->get_signature(entity).test(T::get_id());
+        }
+
+        // Packed storage of a component, iterate it directly for linear scans.
+        // Only available with StorageMode::sparse_set.
+        template <typename T>
+        ComponentArray<T> *get_component_array() {
+            return component_manager->get_component_array<T>();
+        }
+
+        // Calls fn with references to the components of every entity in the query that passes
+        // its filters. With the archetype storage this streams over the chunk columns of the
+        // matching archetypes. Components that are not const in Ts are marked as changed, e.g.
+        // for_each<CPosition, const CVelocity> only marks the positions.
+        template <typename... Ts, typename Fn>
+        void for_each(Query &query, Fn fn) {
+            if (storage_mode == StorageMode::archetype) {
+                archetype_manager->for_each<Ts...>(query, get_change_tick(), fn);
+                return;
+            }
+
+            if (query.filter.is_empty()) {
+                EntityArray *entities = query.get_entities();
+                for_each_sparse_set<Ts...>(entities->first(), 0, entities->size(), get_change_tick(), fn);
+            } else {
+                ComponentID driver = filter_driver(query);
+                u32 count = component_manager->get_component_array(driver)->size();
+                for_each_sparse_set_filtered<Ts...>(query, driver, 0, count, get_change_tick(), fn);
+            }
+        }
+
+        // Runs fn over the query on the job pool, see Query::par_for_each.
+        template <typename... Ts, typename Fn>
+        void par_for_each(Query &query, Fn fn, u32 grain = DEFAULT_QUERY_GRAIN) {
+            if (grain == 0) grain = 1;
+            if (storage_mode == StorageMode::archetype) {
+                par_for_each_archetype<Ts...>(query, fn, grain);
+            } else {
+                par_for_each_sparse_set<Ts...>(query, fn, grain);
+            }
         }
 
         template <typename T>
         T *register_system() {
-            return system_manager->register_system<T>();
+            T *system = system_manager->register_system<T>();
+            for (u32 i = 0; i < system->query_count; i++) {
+                system->queries[i].ecs = this;
+            }
+            return system;
         }
 
+        // Runs all registered systems, see SystemManager::update, then flushes the commands
+        // they recorded.
+        void update();
+
+        // Command buffer of the calling thread. Systems record structural changes here instead
+        // of calling create_entity, add_component, ... directly while iterating queries.
+        CommandBuffer *get_command_buffer() {
+            return &command_buffers[job_pool->get_thread_index()];
+        }
+
+        // Applies the recorded commands of every thread. The commands are sorted by entity so
+        // every entity gets one signature change no matter how many components were added and
+        // removed. Destroys are applied last.
+        void flush();
+
         template <typename T>
         void set_system_signature(Signature signature) {
             system_manager->set_signature<T>(signature);
         }
 
+        template <typename T, typename... Args>
+        T* insert_resource(Args&&... args) {
+            return resource_manager->insert_resource<T>(std::forward<Args>(args)...);
+        }
+
         template <typename T>
         T* register_resource(T* resource) {
             return resource_manager->register_resource(resource);
         }
 
+        template <typename T>
+        void remove_resource() {
+            resource_manager->remove_resource<T>();
+        }
+
         template <typename T>
         T* get_resource() {
             return resource_manager->get_resource<T>();
         }
+
+        // Systems using these should declare Res<T> or ResMut<T> so they are scheduled apart
+        // from systems writing the resource.
+        template <typename T>
+        Res<T> resource() {
+            return Res<T>(resource_manager->get_resource<T>());
+        }
+
+        template <typename T>
+        ResMut<T> resource_mut() {
+            return ResMut<T>(resource_manager->get_resource<T>());
+        }
+
+        StorageMode get_storage_mode() {
+            return storage_mode;
+        }
+
+        JobPool *get_job_pool() {
+            return job_pool;
+        }
     private:
+        // Type erased storage operations used when applying commands.
+        struct ComponentOps {
+            void (*store)(ECS &ecs, Entity entity, const void *component);
+            void (*erase)(ECS &ecs, Entity entity);
+        };
+
+        // A command from one of the buffers along with its component data.
+        struct FlushCommand {
+            Command command;
+            const u8 *payload;
+        };
+
+        // Writes the component into the storage, the entity signature is updated by the caller.
+        template <typename T>
+        static void store_component(ECS &ecs, Entity entity, const void *component) {
+            if (ecs.storage_mode == StorageMode::archetype) {
+                ecs.archetype_manager->get_component<T>(entity) = *(const T*)component;
+                ecs.archetype_manager->mark_changed(entity, T::get_id(), ecs.get_change_tick());
+            } else {
+                ecs.component_manager->add_component(entity, *(const T*)component, ecs.get_change_tick());
+            }
+        }
+
+        template <typename T>
+        T& get_component_unmarked(Entity entity) {
+            if (storage_mode == StorageMode::archetype) {
+                return archetype_manager->get_component<T>(entity);
+            }
+            return component_manager->get_component<T>(entity);
+        }
+
+        // Fetches a component for for_each, marking it as changed unless T is const.
+        template <typename T>
+        static T& fetch_component(ComponentArray<std::remove_const_t<T>> *array, Entity entity, u32 tick) {
+            if constexpr (!std::is_const_v<T>) {
+                array->mark_changed(entity, tick);
+            }
+            return array->get_component(entity);
+        }
+
+        // Iterates entities [begin, end) of a query with the sparse set storage.
+        template <typename... Ts, typename Fn>
+        void for_each_sparse_set(const Entity *entities, u32 begin, u32 end, u32 tick, Fn &fn) {
+            std::tuple<ComponentArray<std::remove_const_t<Ts>>*...> arrays = {
+                component_manager->get_component_array<std::remove_const_t<Ts>>()...
+            };
+            for (u32 i = begin; i < end; i++) {
+                Entity e = entities[i];
+                fn(fetch_component<Ts>(std::get<ComponentArray<std::remove_const_t<Ts>>*>(arrays), e, tick)...);
+            }
+        }
+
+        // The archetype storage drops components when the signature changes.
+        template <typename T>
+        static void erase_component(ECS &ecs, Entity entity) {
+            if (ecs.storage_mode == StorageMode::sparse_set) {
+                ecs.component_manager->remove_component<T>(entity);
+            }
+        }
+
+        void apply_commands(Entity entity, const FlushCommand *commands, u32 count);
+
+        // A filtered query scans the packed ticks of the filtered component with the fewest
+        // entities instead of looking up the ticks of every entity in the query.
+        ComponentID filter_driver(Query &query);
+
+        // Iterates the packed rows [begin, end) of the driver component and visits the ones
+        // that belong to the query and pass its filters.
+        template <typename... Ts, typename Fn>
+        void for_each_sparse_set_filtered(Query &query, ComponentID driver_id, u32 begin, u32 end, u32 tick, Fn &fn) {
+            std::tuple<ComponentArray<std::remove_const_t<Ts>>*...> arrays = {
+                component_manager->get_component_array<std::remove_const_t<Ts>>()...
+            };
+            IComponentArray *driver = component_manager->get_component_array(driver_id);
+            bool driver_changed = query.filter.changed.test(driver_id);
+            bool driver_added = query.filter.added.test(driver_id);
+
+            std::vector<IComponentArray*> changed;
+            std::vector<IComponentArray*> added;
+            for (ComponentID id = 0; id < MAX_COMPONENTS; id++) {
+                if (id == driver_id) continue;
+                if (query.filter.changed.test(id)) changed.push_back(component_manager->get_component_array(id));
+                if (query.filter.added.test(id)) added.push_back(component_manager->get_component_array(id));
+            }
+
+            u32 since = query.last_run_tick;
+            for (u32 i = begin; i < end; i++) {
+                ComponentTicks ticks = driver->ticks_at(i);
+                if (driver_changed && !ticks.is_changed(since)) continue;
+                if (driver_added && !ticks.is_added(since)) continue;
+                Entity e = driver->entity_at(i);
+                if (!query.is_in(e)) continue;
+                bool passes = true;
+                for (IComponentArray *array : changed) passes &= array->get_ticks(e).is_changed(since);
+                for (IComponentArray *array : added) passes &= array->get_ticks(e).is_added(since);
+                if (!passes) continue;
+                fn(fetch_component<Ts>(std::get<ComponentArray<std::remove_const_t<Ts>>*>(arrays), e, tick)...);
+            }
+        }
+
+        template <typename... Ts, typename Fn>
+        void par_for_each_sparse_set(Query &query, Fn &fn, u32 grain) {
+            struct Context {
+                ECS *ecs;
+                Query *query;
+                Entity *entities;
+                // Only used by filtered queries, which split the rows of the driver instead.
+                ComponentID driver;
+                u32 count;
+                u32 grain;
+                u32 tick;
+                Fn *fn;
+
+                // Job `index` covers the entities [index * grain, (index + 1) * grain).
+                static void run(void *context, u32 index) {
+                    Context *c = (Context*)context;
+                    u32 begin = index * c->grain;
+                    u32 end = std::min(begin + c->grain, c->count);
+                    if (c->query->filter.is_empty()) {
+                        c->ecs->template for_each_sparse_set<Ts...>(c->entities, begin, end, c->tick, *c->fn);
+                    } else {
+                        c->ecs->template for_each_sparse_set_filtered<Ts...>(*c->query, c->driver, begin, end, c->tick, *c->fn);
+                    }
+                }
+            };
+
+            EntityArray *entities = query.get_entities();
+            Context context = {
+                .ecs = this,
+                .query = &query,
+                .entities = entities->first(),
+                .driver = 0,
+                .count = entities->size(),
+                .grain = grain,
+                .tick = get_change_tick(),
+                .fn = &fn,
+            };
+            if (!query.filter.is_empty()) {
+                context.driver = filter_driver(query);
+                context.count = component_manager->get_component_array(context.driver)->size();
+            }
+            run_jobs(Context::run, &context, (context.count + grain - 1) / grain);
+        }
+
+        template <typename... Ts, typename Fn>
+        void par_for_each_archetype(Query &query, Fn &fn, u32 grain) {
+            struct Context {
+                ArchetypeManager *archetypes;
+                Query *query;
+                std::vector<ChunkRange> ranges;
+                u32 tick;
+                Fn *fn;
+
+                static void run(void *context, u32 index) {
+                    Context *c = (Context*)context;
+                    c->archetypes->template for_each_in_range<Ts...>(*c->query, c->ranges[index], c->tick, *c->fn);
+                }
+            };
+
+            Context context = {
+                .archetypes = archetype_manager,
+                .query = &query,
+                .ranges = {},
+                .tick = get_change_tick(),
+                .fn = &fn,
+            };
+            archetype_manager->split_query(query, grain, context.ranges);
+            run_jobs(Context::run, &context, context.ranges.size());
+        }
+
+        // Runs function(context, i) for i in [0, job_count) and waits for all of them.
+        void run_jobs(void (*function)(void *context, u32 index), void *context, u32 job_count);
+
+        StorageMode storage_mode;
+        // Starts at 1 so that everything counts as changed for a system that never ran.
+        std::atomic<u32> change_tick;
+        JobPool *job_pool;
         EntityManager *entity_manager;
         ComponentManager *component_manager;
+        ArchetypeManager *archetype_manager;
         SystemManager *system_manager;
         ResourceManager *resource_manager;
+        ComponentOps component_ops[MAX_COMPONENTS];
+        // One per job pool thread.
+        std::vector<CommandBuffer> command_buffers;
+        std::vector<FlushCommand> flush_commands;
+        std::vector<Entity> flush_destroyed;
 };
+
+template <typename... Ts, typename Fn>
+void Query::for_each(Fn fn) {
+    ecs->for_each<Ts...>(*this, fn);
+}
+
+template <typename... Ts, typename Fn>
+void Query::par_for_each(Fn fn, u32 grain) {
+    ecs->par_for_each<Ts...>(*this, fn, grain);
+}
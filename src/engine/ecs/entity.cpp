@@ -1,34 +1,93 @@
 #include "entity.hpp"
+#include "engine/utils/logging.h"
 
-EntityManager::EntityManager() : available_entities(MAX_ENTITIES) {
+EntityManager::EntityManager() {
     entity_count = 0;
-    for (Entity entity = 0; entity < MAX_ENTITIES; entity++) {
-        available_entities.push(entity);
-    }
+    next_index = 0;
 }
 
 EntityManager::~EntityManager() {
 }
 
 Entity EntityManager::create_entity() {
-    Entity entity = available_entities.pop();
-    entity_count++;
+    Entity entity = reserve_entity();
+    activate_entity(entity);
     return entity;
 }
 
+Entity EntityManager::reserve_entity() {
+    std::lock_guard<std::mutex> lock(reserve_mutex);
+    if (!free_indices.empty()) {
+        u32 index = free_indices.back();
+        free_indices.pop_back();
+        return make_entity(index, generations[index]);
+    }
+
+    if (next_index >= MAX_ENTITIES) {
+        ERROR("Entity count exceeds maximum entities");
+        exit(1);
+    }
+    return make_entity(next_index++, 0);
+}
+
+void EntityManager::activate_entity(Entity entity) {
+    u32 index = entity_index(entity);
+    if (index >= generations.size()) {
+        generations.resize(index + 1, 0);
+        alive.resize(index + 1, 0);
+    }
+    alive[index] = 1;
+
+    u32 page = index / ENTITY_PAGE_SIZE;
+    if (page >= pages.size()) {
+        pages.resize(page + 1);
+    }
+    if (pages[page] == nullptr) {
+        pages[page] = std::make_unique<Page>();
+        pages[page]->live_count = 0;
+    }
+    pages[page]->live_count++;
+    pages[page]->signatures[index % ENTITY_PAGE_SIZE] = Signature();
+
+    entity_count++;
+}
+
 void EntityManager::destroy_entity(Entity entity) {
-    available_entities.push(entity);
+    if (!is_alive(entity)) return;
+
+    u32 index = entity_index(entity);
+    generations[index] = (generations[index] + 1) & ENTITY_GENERATION_MASK;
+    alive[index] = 0;
+    {
+        std::lock_guard<std::mutex> lock(reserve_mutex);
+        free_indices.push_back(index);
+    }
+
+    u32 page = index / ENTITY_PAGE_SIZE;
+    if (--pages[page]->live_count == 0) {
+        pages[page].reset();
+    }
     entity_count--;
 }
 
+bool EntityManager::is_alive(Entity entity) {
+    u32 index = entity_index(entity);
+    return index < generations.size() && alive[index] &&
+           generations[index] == entity_generation(entity);
+}
+
+Signature &EntityManager::signature_slot(u32 index) {
+    return pages[index / ENTITY_PAGE_SIZE]->signatures[index % ENTITY_PAGE_SIZE];
+}
+
 void EntityManager::set_signature(Entity entity, Signature signature) {
-    signatures[entity] = signature;
+    signature_slot(entity_index(entity)) = signature;
 }
 
 Signature EntityManager::get_signature(Entity entity) {
-    return signatures[entity];
+    return signature_slot(entity_index(entity));
 }
 
-FIFO<Entity> available_entities = FIFO<Entity>(MAX_ENTITIES);
-Signature signatures[MAX_ENTITIES];
-u32 entity_count;
+u32 EntityManager::get_entity_count() {
+    return entity_count;
+}
@@ -3,10 +3,36 @@
 #include "types.h"
 #include "signature.hpp"
 #include "utils.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
 
+// An entity handle is an index into the entity storage and a generation that is bumped every
+// time the index is recycled, so handles to destroyed entities can be detected in O(1).
 using Entity = u32;
 
-const u32 MAX_ENTITIES = 1000;
+const u32 ENTITY_INDEX_BITS = 22;
+const u32 ENTITY_GENERATION_BITS = 32 - ENTITY_INDEX_BITS;
+const u32 ENTITY_INDEX_MASK = (1u << ENTITY_INDEX_BITS) - 1;
+const u32 ENTITY_GENERATION_MASK = (1u << ENTITY_GENERATION_BITS) - 1;
+// Limit imposed by the handle layout, the last index is reserved so INVALID_ENTITY is never handed out.
+const u32 MAX_ENTITIES = ENTITY_INDEX_MASK;
+const Entity INVALID_ENTITY = UINT32_MAX;
+
+// Signatures are stored in pages that are released when they no longer hold a live entity.
+const u32 ENTITY_PAGE_SIZE = 4096;
+
+inline u32 entity_index(Entity entity) {
+    return entity & ENTITY_INDEX_MASK;
+}
+
+inline u32 entity_generation(Entity entity) {
+    return entity >> ENTITY_INDEX_BITS;
+}
+
+inline Entity make_entity(u32 index, u32 generation) {
+    return (generation << ENTITY_INDEX_BITS) | index;
+}
 
 class EntityManager {
     public:
@@ -16,13 +42,40 @@ class EntityManager {
 
         Entity create_entity();
 
+        // Hands out a handle without touching the entity storage, so systems running in
+        // parallel can create entities. The entity only becomes usable after activate_entity,
+        // which command buffers call when they are flushed.
+        Entity reserve_entity();
+
+        void activate_entity(Entity entity);
+
         void destroy_entity(Entity entity);
 
+        bool is_alive(Entity entity);
+
         void set_signature(Entity entity, Signature signature);
 
         Signature get_signature(Entity entity);
+
+        u32 get_entity_count();
     private:
-        FIFO<Entity> available_entities;
-        Signature signatures[MAX_ENTITIES];
+        struct Page {
+            Signature signatures[ENTITY_PAGE_SIZE];
+            u32 live_count;
+        };
+
+        // Recycled indices, reused last in first out.
+        std::vector<u32> free_indices;
+        // First index that has never been handed out, can be ahead of generations.size()
+        // while there are reserved entities.
+        u32 next_index;
+        std::mutex reserve_mutex;
+        std::vector<u16> generations;
+        // Set between activate_entity and destroy_entity, a reserved handle has the current
+        // generation of its index but is not alive yet.
+        std::vector<u8> alive;
+        std::vector<std::unique_ptr<Page>> pages;
         u32 entity_count;
+
+        Signature &signature_slot(u32 index);
 };
@@ -4,51 +4,42 @@
 
 // Packed array of entities
 EntityArray::EntityArray() {
-    for (u32 i = 0; i < MAX_ENTITIES; i++) {
-        idxs[i] = -1;
-        data[i] = -1;
-    }
     head = 0;
-    size = 0;
 }
 
 EntityArray::~EntityArray() {
 }
 
 void EntityArray::insert(Entity e) {
-    if (idxs[e] != -1) return;
-    data[head] = e;
-    idxs[e] = head;
+    if (is_in(e)) return;
+    u32 index = entity_index(e);
+    if (index >= idxs.size()) {
+        idxs.resize(index + 1, INVALID_ENTITY);
+    }
+    data.push_back(e);
+    idxs[index] = head;
     head++;
 }
 
 void EntityArray::remove(Entity e) {
-    if (idxs[e] == -1) return;
-    // IDX av entity
-    // Ta bort entity
-    // Ta bort IDX
-    // Om IDX != head - 1 && head - 1 != 0
-    //   E2 = data[head - 1]
-    //   data[idx] = E2
-    //   data[head - 1] = 0
-    //   idxs[E2] = idx
+    if (!is_in(e)) return;
 
-    u32 idx = idxs[e];
-    idxs[e] = -1;
-    if (idx != head - 1 && head - 1 != 0) {
+    // Move the last entity into the hole left by the removed one.
+    u32 idx = idxs[entity_index(e)];
+    idxs[entity_index(e)] = INVALID_ENTITY;
+    if (idx != head - 1) {
         Entity e2 = data[head - 1];
         data[idx] = e2;
-        data[head - 1] = 0;
-        idxs[e2] = idx;
+        idxs[entity_index(e2)] = idx;
     }
 
-    if (!(head - 1 < 0)) {
-        head--;
-    }
+    data.pop_back();
+    head--;
 }
 
 bool EntityArray::is_in(Entity e) {
-    return idxs[e] != -1;
+    u32 index = entity_index(e);
+    return index < idxs.size() && idxs[index] != INVALID_ENTITY && data[idxs[index]] == e;
 }
 
 bool EntityArray::next(Iterator &it, Entity &e) {
@@ -62,3 +53,7 @@ Entity *EntityArray::first() {
     if (head == 0) return nullptr;
     return &data[0];
 }
+
+u32 EntityArray::size() {
+    return head;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "entity.hpp"
+#include <vector>
 
 struct Iterator {
     u32 next;
@@ -8,10 +9,10 @@ struct Iterator {
 
 class EntityArray {
     private:
-        Entity data[MAX_ENTITIES];
-        u32 idxs[MAX_ENTITIES];
+        std::vector<Entity> data;
+        // Position of every entity in `data` indexed by entity index, INVALID_ENTITY if absent.
+        std::vector<u32> idxs;
         u32 head;
-        u32 size;
     public:
         EntityArray();
 
@@ -26,4 +27,6 @@ class EntityArray {
         bool next(Iterator &it, Entity &e);
 
         Entity *first();
+
+        u32 size();
 };
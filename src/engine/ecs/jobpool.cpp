@@ -0,0 +1,110 @@
+#include "jobpool.hpp"
+#include <algorithm>
+
+// Queue of the current thread, threads that are not workers share queue 0.
+static thread_local u32 current_queue = 0;
+static thread_local JobPool *current_pool = nullptr;
+
+JobPool::JobPool(u32 thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    queued_jobs = 0;
+    stopping = false;
+    for (u32 i = 0; i < thread_count; i++) {
+        queues.push_back(new WorkerQueue());
+    }
+    for (u32 i = 1; i < thread_count; i++) {
+        workers.emplace_back(&JobPool::worker_main, this, i);
+    }
+}
+
+JobPool::~JobPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    for (WorkerQueue *queue : queues) {
+        delete queue;
+    }
+}
+
+u32 JobPool::get_thread_index() {
+    return current_pool == this ? current_queue : 0;
+}
+
+void JobPool::push(Job job) {
+    u32 queue_index = get_thread_index();
+    WorkerQueue *queue = queues[queue_index];
+    queued_jobs.fetch_add(1, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->jobs.push_back(job);
+    }
+    if (!workers.empty()) {
+        // Taking the lock orders the wakeup after a worker that is about to sleep has checked
+        // queued_jobs.
+        { std::lock_guard<std::mutex> lock(sleep_mutex); }
+        wake.notify_one();
+    }
+}
+
+bool JobPool::pop(u32 queue_index, Job &job) {
+    WorkerQueue *queue = queues[queue_index];
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->jobs.empty()) return false;
+    job = queue->jobs.back();
+    queue->jobs.pop_back();
+    return true;
+}
+
+bool JobPool::steal(u32 queue_index, Job &job) {
+    u32 queue_count = queues.size();
+    for (u32 i = 1; i < queue_count; i++) {
+        WorkerQueue *queue = queues[(queue_index + i) % queue_count];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (queue->jobs.empty()) continue;
+        job = queue->jobs.front();
+        queue->jobs.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void JobPool::run(Job &job) {
+    queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+    job.function(job.context, job.index);
+    job.counter->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobPool::wait(std::atomic<u32> &counter) {
+    u32 queue_index = get_thread_index();
+    Job job;
+    while (counter.load(std::memory_order_acquire) != 0) {
+        if (pop(queue_index, job) || steal(queue_index, job)) {
+            run(job);
+        } else {
+            // The remaining jobs are running on other threads.
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobPool::worker_main(u32 queue_index) {
+    current_queue = queue_index;
+    current_pool = this;
+    Job job;
+    while (true) {
+        if (pop(queue_index, job) || steal(queue_index, job)) {
+            run(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this] { return stopping || queued_jobs.load(std::memory_order_acquire) != 0; });
+        if (stopping) return;
+    }
+}
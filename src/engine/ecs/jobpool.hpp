@@ -0,0 +1,66 @@
+#pragma once
+
+#include "types.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A unit of work, `function` is called with `context` and `index` on one of the workers.
+// `counter` is decremented once the job has run so that the submitter can wait on it.
+struct Job {
+    void (*function)(void *context, u32 index);
+    void *context;
+    u32 index;
+    std::atomic<u32> *counter;
+};
+
+// Work stealing thread pool. Every worker owns a deque, it pushes and pops jobs at the back and
+// idle workers steal from the front of the other deques. The thread calling wait() runs jobs as
+// well so a pool with zero worker threads executes everything inline.
+class JobPool {
+    public:
+        // Total number of threads running jobs including the one calling wait(), 0 uses one
+        // thread per hardware thread and 1 runs every job inline.
+        JobPool(u32 thread_count = 0);
+
+        ~JobPool();
+
+        // The counter must have been incremented for the job before it is pushed.
+        void push(Job job);
+
+        // Runs and steals jobs until the counter reaches zero.
+        void wait(std::atomic<u32> &counter);
+
+        // Index of the calling thread in [0, get_thread_count()), threads that are not
+        // workers of this pool get 0.
+        u32 get_thread_index();
+
+        // Number of threads executing jobs, including the thread calling wait().
+        u32 get_thread_count() {
+            return workers.size() + 1;
+        }
+    private:
+        struct WorkerQueue {
+            std::mutex mutex;
+            std::deque<Job> jobs;
+        };
+
+        // Queue 0 belongs to the threads calling wait(), queue i + 1 to worker thread i.
+        std::vector<WorkerQueue*> queues;
+        std::vector<std::thread> workers;
+        std::atomic<u32> queued_jobs;
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        bool stopping;
+
+        bool pop(u32 queue_index, Job &job);
+
+        bool steal(u32 queue_index, Job &job);
+
+        void run(Job &job);
+
+        void worker_main(u32 queue_index);
+};
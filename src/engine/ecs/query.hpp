@@ -1,6 +1,42 @@
+#pragma once
+
 #include "engine/ecs/component.hpp"
 #include "engine/ecs/entityarray.hpp"
 #include "engine/ecs/signature.hpp"
+#include <vector>
+
+class ECS;
+
+// Default number of entities per job of par_for_each.
+const u32 DEFAULT_QUERY_GRAIN = 1024;
+
+// Components whose ticks are tested before an entity is handed to for_each, an entity passes
+// when every listed component changed (or was added) since the system last ran.
+struct QueryFilter {
+    Signature changed;
+    Signature added;
+
+    bool is_empty() const {
+        return changed.none() && added.none();
+    }
+};
+
+// Filter tags for Query::with, e.g. Query(CTransform::get_id()).with<Changed<CTransform>>().
+// Adding a component also counts as changing it.
+template <typename... Cs>
+struct Changed {
+    static void declare(QueryFilter &filter) {
+        (filter.changed.set(Cs::get_id()), ...);
+    }
+};
+
+template <typename... Cs>
+struct Added {
+    static void declare(QueryFilter &filter) {
+        (filter.added.set(Cs::get_id()), ...);
+    }
+};
+
 class Query {
     private:
         Signature signature;
@@ -11,9 +47,8 @@ class Query {
         template <typename... ComponentIDs>
         Query(ComponentIDs... component_ids) {
             signature = Signature();
-            int i = 0;
             for (auto component_id : {component_ids...}) {
-                set_signature(signature, component_id);
+                signature = set_signature(signature, component_id);
             }
         }
         void add_entity(Entity entity) {
@@ -35,5 +70,40 @@ class Query {
         bool is_in(Entity entity) {
             return entities.is_in(entity);
         }
+
+        // The filtered components are added to the signature as well.
+        template <typename... Filters>
+        Query &with() {
+            (Filters::declare(filter), ...);
+            signature = signature | filter.changed | filter.added;
+            return *this;
+        }
+
+        // Calls fn with references to the components of every entity in the query. Only
+        // available once the owning system has been registered, defined in ecs.hpp.
+        template <typename... Ts, typename Fn>
+        void for_each(Fn fn);
+
+        // Same as for_each but the entities are split into jobs of about `grain` entities that
+        // run on the job pool of the ECS. fn is called concurrently and must only write to the
+        // components it is handed.
+        template <typename... Ts, typename Fn>
+        void par_for_each(Fn fn, u32 grain = DEFAULT_QUERY_GRAIN);
+
+        // Set when the owning system is registered.
+        ECS *ecs = nullptr;
+
+        QueryFilter filter;
+        // Change tick at the end of the last run of the owning system, the filters compare
+        // against it. Updated by the scheduler.
+        u32 last_run_tick = 0;
         EntityArray entities;
+
+        // Last SystemManager update that tested this query.
+        u32 update_stamp = 0;
+
+        // Archetypes matching the query, only used by the archetype storage. Archetypes are
+        // never removed so the cache is extended with the ones created since the last check.
+        std::vector<u32> archetypes;
+        u32 archetypes_checked = 0;
 };
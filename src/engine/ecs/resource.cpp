@@ -1,14 +1,57 @@
 #include "types.h"
 #include "resource.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
 
 u32 ResourceBase::id_counter = 0;
 
 ResourceManager::ResourceManager() {
-    resource_count = 0;
+    for (u32 i = 0; i < MAX_RESOURCES; i++) {
+        slots[i].data.store(nullptr, std::memory_order_relaxed);
+        slots[i].destroy = nullptr;
+        slots[i].storage = nullptr;
+    }
+    block_used = RESOURCE_BLOCK_SIZE;
 }
 
 ResourceManager::~ResourceManager() {
-    for (u32 i = 0; i < resource_count; i++) {
-        delete resources[i];
+    // Resource ids are global so any slot can be in use, not just the first few.
+    for (u32 i = 0; i < MAX_RESOURCES; i++) {
+        release(i);
+    }
+    for (u8 *block : blocks) {
+        std::free(block);
+    }
+}
+
+void *ResourceManager::allocate(u32 size, u32 alignment) {
+    alignment = std::max(alignment, (u32)alignof(std::max_align_t));
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    // Blocks are only aligned for ordinary types, over aligned resources get their own memory
+    // as well.
+    if (size > RESOURCE_BLOCK_SIZE || alignment > alignof(std::max_align_t)) {
+        // Inserted before the current block so that the bump allocator keeps using it.
+        u8 *block = (u8*)std::aligned_alloc(alignment, size);
+        blocks.insert(blocks.end() - (blocks.empty() ? 0 : 1), block);
+        return block;
+    }
+
+    u32 offset = (block_used + alignment - 1) & ~(alignment - 1);
+    if (blocks.empty() || offset + size > RESOURCE_BLOCK_SIZE) {
+        blocks.push_back((u8*)std::aligned_alloc(alignof(std::max_align_t), RESOURCE_BLOCK_SIZE));
+        offset = 0;
+    }
+    block_used = offset + size;
+    return blocks.back() + offset;
+}
+
+// The storage of the slot is kept for the next insert, block memory is only reclaimed with the
+// manager.
+void ResourceManager::release(u32 resource_id) {
+    void *resource = slots[resource_id].data.exchange(nullptr, std::memory_order_acq_rel);
+    if (resource != nullptr) {
+        slots[resource_id].destroy(resource);
     }
 }
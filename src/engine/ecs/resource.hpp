@@ -1,8 +1,31 @@
 #pragma  once
 #include "engine/utils/logging.h"
 #include "types.h"
+#include <atomic>
+#include <new>
+#include <utility>
+#include <vector>
 
 const u32 MAX_RESOURCES = 128;
+// Resources are placed in blocks of this size, bigger resources get a block of their own.
+const u32 RESOURCE_BLOCK_SIZE = 64 * 1024;
+const u32 RESOURCE_MASK_WORDS = (MAX_RESOURCES + 63) / 64;
+
+// Bitset of resource ids, used by the scheduler to find systems sharing resources.
+struct ResourceMask {
+    u64 words[RESOURCE_MASK_WORDS] = {};
+
+    void set(u32 resource_id) {
+        words[resource_id / 64] |= 1ull << (resource_id % 64);
+    }
+
+    bool intersects(const ResourceMask &other) const {
+        for (u32 i = 0; i < RESOURCE_MASK_WORDS; i++) {
+            if ((words[i] & other.words[i]) != 0) return true;
+        }
+        return false;
+    }
+};
 
 class ResourceBase  {
     protected:
@@ -26,26 +49,76 @@ class Resource: public ResourceBase {
         }
 };
 
+// Typed resource store. Resources live in blocks that are never moved or freed before the
+// manager, so their addresses are stable, and every slot is published with an atomic store
+// so that systems running in parallel can look resources up without locking. Inserting and
+// removing resources must not happen while systems are running.
 class ResourceManager {
     private:
-        ResourceBase *resources[MAX_RESOURCES];
-        u32 resource_count;
+        struct Slot {
+            std::atomic<void*> data;
+            // Destroys the resource, frees it as well if it was not allocated in a block.
+            void (*destroy)(void *resource);
+            // Memory for insert_resource, allocated by the first insert. A slot only ever holds
+            // one type, so replacing the resource constructs the new one into it.
+            void *storage;
+        };
+
+        Slot slots[MAX_RESOURCES];
+        std::vector<u8*> blocks;
+        u32 block_used;
+
+        void *allocate(u32 size, u32 alignment);
+
+        void release(u32 resource_id);
+
+        template <typename T>
+        static void destroy_in_place(void *resource) {
+            ((T*)resource)->~T();
+        }
+
+        template <typename T>
+        static void destroy_owned(void *resource) {
+            delete (T*)resource;
+        }
     public:
         ResourceManager();
 
         ~ResourceManager();
 
+        // Constructs the resource in place, replacing the previous one of the same type.
+        template <typename T, typename... Args>
+        T* insert_resource(Args&&... args) {
+            const u32 resource_id = T::get_id();
+            release(resource_id);
+            if (slots[resource_id].storage == nullptr) {
+                slots[resource_id].storage = allocate(sizeof(T), alignof(T));
+            }
+            T *resource = new (slots[resource_id].storage) T(std::forward<Args>(args)...);
+            slots[resource_id].destroy = destroy_in_place<T>;
+            slots[resource_id].data.store(resource, std::memory_order_release);
+            return resource;
+        }
+
+        // Takes ownership of a heap allocated resource.
         template <typename T>
         T* register_resource(T* resource) {
             const u32 resource_id = T::get_id();
-            resources[resource_id] = resource;
-            resource_count++;
-            return (T*)resources[resource_id];
+            release(resource_id);
+            slots[resource_id].destroy = destroy_owned<T>;
+            slots[resource_id].data.store(resource, std::memory_order_release);
+            return resource;
+        }
+
+        template <typename T>
+        void remove_resource() {
+            release(T::get_id());
         }
 
+        // nullptr if the resource has not been inserted.
         template <typename T>
         T* get_resource() {
             const u32 resource_id = T::get_id();
-            return (T*)resources[resource_id];
+            return static_cast<T*>(slots[resource_id].data.load(std::memory_order_acquire));
         }
 };
@@ -1,9 +1,109 @@
 #include "signature.hpp"
 
-Signature set_signature(Signature signature, u32 component_id) {
-    return signature | (std::bitset<MAX_COMPONENTS>(1) << component_id);
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIGNATURE_SIMD 1
+#endif
+
+static u32 match_signatures_scalar(const Signature *signatures, u32 first, u32 count,
+                                   const Signature &mask, u32 *matches, u32 match_count) {
+    for (u32 i = first; i < count; i++) {
+        if (signatures[i].contains(mask)) {
+            matches[match_count++] = i;
+        }
+    }
+    return match_count;
+}
+
+#ifdef SIGNATURE_SIMD
+// Signatures are tightly packed words, so the batch is one contiguous array of u64 and the
+// mask is repeated to line up with it. A signature matches when (words & mask) == mask for
+// every one of its words.
+static u32 match_signatures_sse2(const Signature *signatures, u32 count, const Signature &mask,
+                                 u32 *matches) {
+    u32 match_count = 0;
+    const u64 *words = signatures[0].words;
+    u32 i = 0;
+
+    if constexpr (SIGNATURE_WORDS == 1) {
+        // Two signatures per register, compared as 32-bit halves.
+        __m128i m = _mm_set1_epi64x(mask.words[0]);
+        for (; i + 2 <= count; i += 2) {
+            __m128i s = _mm_loadu_si128((const __m128i *)(words + i));
+            __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(s, m), m);
+            u32 bits = _mm_movemask_ps(_mm_castsi128_ps(eq));
+            if ((bits & 0x3) == 0x3) matches[match_count++] = i;
+            if ((bits & 0xc) == 0xc) matches[match_count++] = i + 1;
+        }
+    } else if constexpr (SIGNATURE_WORDS % 2 == 0) {
+        for (; i < count; i++) {
+            const u64 *signature = words + i * SIGNATURE_WORDS;
+            u32 all = 0xf;
+            for (u32 w = 0; w < SIGNATURE_WORDS; w += 2) {
+                __m128i m = _mm_loadu_si128((const __m128i *)(mask.words + w));
+                __m128i s = _mm_loadu_si128((const __m128i *)(signature + w));
+                __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(s, m), m);
+                all &= _mm_movemask_ps(_mm_castsi128_ps(eq));
+            }
+            if (all == 0xf) matches[match_count++] = i;
+        }
+    }
+
+    return match_signatures_scalar(signatures, i, count, mask, matches, match_count);
+}
+
+__attribute__((target("avx2")))
+static u32 match_signatures_avx2(const Signature *signatures, u32 count, const Signature &mask,
+                                 u32 *matches) {
+    u32 match_count = 0;
+    const u64 *words = signatures[0].words;
+    u32 i = 0;
+
+    if constexpr (SIGNATURE_WORDS == 1 || SIGNATURE_WORDS == 2) {
+        // Four words per register, so four or two signatures per iteration.
+        const u32 per_register = 4 / SIGNATURE_WORDS;
+        __m256i m = SIGNATURE_WORDS == 1
+                        ? _mm256_set1_epi64x(mask.words[0])
+                        : _mm256_setr_epi64x(mask.words[0], mask.words[SIGNATURE_WORDS - 1],
+                                             mask.words[0], mask.words[SIGNATURE_WORDS - 1]);
+        for (; i + per_register <= count; i += per_register) {
+            __m256i s = _mm256_loadu_si256((const __m256i *)(words + i * SIGNATURE_WORDS));
+            __m256i eq = _mm256_cmpeq_epi64(_mm256_and_si256(s, m), m);
+            u32 bits = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+            for (u32 j = 0; j < per_register; j++) {
+                u32 lane_mask = ((1u << SIGNATURE_WORDS) - 1) << (j * SIGNATURE_WORDS);
+                if ((bits & lane_mask) == lane_mask) matches[match_count++] = i + j;
+            }
+        }
+    } else if constexpr (SIGNATURE_WORDS % 4 == 0) {
+        for (; i < count; i++) {
+            const u64 *signature = words + i * SIGNATURE_WORDS;
+            u32 all = 0xf;
+            for (u32 w = 0; w < SIGNATURE_WORDS; w += 4) {
+                __m256i m = _mm256_loadu_si256((const __m256i *)(mask.words + w));
+                __m256i s = _mm256_loadu_si256((const __m256i *)(signature + w));
+                __m256i eq = _mm256_cmpeq_epi64(_mm256_and_si256(s, m), m);
+                all &= _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+            }
+            if (all == 0xf) matches[match_count++] = i;
+        }
+    } else {
+        return match_signatures_sse2(signatures, count, mask, matches);
+    }
+
+    return match_signatures_scalar(signatures, i, count, mask, matches, match_count);
 }
+#endif
 
-Signature remove_signature(Signature signature, u32 component_id) {
-    return signature & ~(std::bitset<MAX_COMPONENTS>(1) << component_id);
+u32 match_signatures(const Signature *signatures, u32 count, const Signature &mask, u32 *matches) {
+    if (count == 0) return 0;
+#ifdef SIGNATURE_SIMD
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        return match_signatures_avx2(signatures, count, mask, matches);
+    }
+    return match_signatures_sse2(signatures, count, mask, matches);
+#else
+    return match_signatures_scalar(signatures, 0, count, mask, matches, 0);
+#endif
 }
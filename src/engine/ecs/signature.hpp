@@ -1,11 +1,102 @@
 #pragma once
 
 #include "types.h"
-#include <bitset>
+#include <cstddef>
+#include <functional>
 
-const u32 MAX_COMPONENTS = 512;
-using Signature = std::bitset<MAX_COMPONENTS>;
+// The number of component ids is fixed at compile time and rounded up to whole 64-bit words,
+// override ECS_MAX_COMPONENTS when a game registers more components than that.
+#ifndef ECS_MAX_COMPONENTS
+#define ECS_MAX_COMPONENTS 64
+#endif
 
-Signature set_signature(Signature signature, u32 component_id);
+const u32 MAX_COMPONENTS = ECS_MAX_COMPONENTS;
+const u32 SIGNATURE_WORDS = (MAX_COMPONENTS + 63) / 64;
 
-Signature remove_signature(Signature signature, u32 component_id);
+// Bitset of component ids, one bit per registered component.
+struct Signature {
+    u64 words[SIGNATURE_WORDS] = {};
+
+    bool test(u32 component_id) const {
+        return (words[component_id / 64] >> (component_id % 64)) & 1;
+    }
+
+    void set(u32 component_id) {
+        words[component_id / 64] |= 1ull << (component_id % 64);
+    }
+
+    void reset(u32 component_id) {
+        words[component_id / 64] &= ~(1ull << (component_id % 64));
+    }
+
+    bool none() const {
+        for (u32 i = 0; i < SIGNATURE_WORDS; i++) {
+            if (words[i] != 0) return false;
+        }
+        return true;
+    }
+
+    // True if every bit of the mask is also set in this signature.
+    bool contains(const Signature &mask) const {
+        for (u32 i = 0; i < SIGNATURE_WORDS; i++) {
+            if ((words[i] & mask.words[i]) != mask.words[i]) return false;
+        }
+        return true;
+    }
+
+    Signature operator&(const Signature &other) const {
+        Signature result;
+        for (u32 i = 0; i < SIGNATURE_WORDS; i++) result.words[i] = words[i] & other.words[i];
+        return result;
+    }
+
+    Signature operator|(const Signature &other) const {
+        Signature result;
+        for (u32 i = 0; i < SIGNATURE_WORDS; i++) result.words[i] = words[i] | other.words[i];
+        return result;
+    }
+
+    Signature operator^(const Signature &other) const {
+        Signature result;
+        for (u32 i = 0; i < SIGNATURE_WORDS; i++) result.words[i] = words[i] ^ other.words[i];
+        return result;
+    }
+
+    Signature operator~() const {
+        Signature result;
+        for (u32 i = 0; i < SIGNATURE_WORDS; i++) result.words[i] = ~words[i];
+        return result;
+    }
+
+    bool operator==(const Signature &other) const {
+        for (u32 i = 0; i < SIGNATURE_WORDS; i++) {
+            if (words[i] != other.words[i]) return false;
+        }
+        return true;
+    }
+};
+
+template <>
+struct std::hash<Signature> {
+    size_t operator()(const Signature &signature) const {
+        u64 hash = 14695981039346656037ull;
+        for (u32 i = 0; i < SIGNATURE_WORDS; i++) {
+            hash = (hash ^ signature.words[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+};
+
+inline Signature set_signature(Signature signature, u32 component_id) {
+    signature.set(component_id);
+    return signature;
+}
+
+inline Signature remove_signature(Signature signature, u32 component_id) {
+    signature.reset(component_id);
+    return signature;
+}
+
+// Tests `count` signatures against the mask in one pass and writes the indices of the ones
+// containing it to `matches`. Returns the number of matches. Uses AVX2 or SSE2 when available.
+u32 match_signatures(const Signature *signatures, u32 count, const Signature &mask, u32 *matches);
@@ -5,9 +5,114 @@
 #include "types.h"
 #include "entityarray.hpp"
 #include "query.hpp"
+#include "resource.hpp"
 
 const u32 MAX_SYSTEMS = 128;
 
+class ECS;
+
+// Components and resources a system reads and writes. Systems that have not declared anything
+// are assumed to touch everything and never run in parallel with other systems.
+struct SystemAccess {
+    Signature reads;
+    Signature writes;
+    ResourceMask resource_reads;
+    ResourceMask resource_writes;
+    bool declared = false;
+
+    bool conflicts_with(const SystemAccess &other) const {
+        if (!declared || !other.declared) return true;
+        if (!(writes & (other.reads | other.writes)).none() || !(reads & other.writes).none()) {
+            return true;
+        }
+        return resource_writes.intersects(other.resource_reads) ||
+            resource_writes.intersects(other.resource_writes) ||
+            resource_reads.intersects(other.resource_writes);
+    }
+};
+
+// Access tags for System<T, Accesses...>, e.g. System<SMove, Write<CPosition>, Read<CVelocity>>.
+template <typename... Cs>
+struct Read {
+    static void declare(SystemAccess &access) {
+        access.declared = true;
+        (access.reads.set(Cs::get_id()), ...);
+    }
+};
+
+template <typename... Cs>
+struct Write {
+    static void declare(SystemAccess &access) {
+        access.declared = true;
+        (access.writes.set(Cs::get_id()), ...);
+    }
+};
+
+// Shared and exclusive borrows of a resource, see ECS::resource and ECS::resource_mut. Listing
+// them as access tags, e.g. System<SRender, Read<CPosition>, Res<Camera>>, lets systems that
+// only read a resource run in parallel.
+template <typename T>
+class Res {
+    public:
+        Res(const T *resource) {
+            this->resource = resource;
+        }
+
+        static void declare(SystemAccess &access) {
+            access.declared = true;
+            access.resource_reads.set(T::get_id());
+        }
+
+        const T *get() const {
+            return resource;
+        }
+
+        const T *operator->() const {
+            return resource;
+        }
+
+        const T &operator*() const {
+            return *resource;
+        }
+
+        explicit operator bool() const {
+            return resource != nullptr;
+        }
+    private:
+        const T *resource;
+};
+
+template <typename T>
+class ResMut {
+    public:
+        ResMut(T *resource) {
+            this->resource = resource;
+        }
+
+        static void declare(SystemAccess &access) {
+            access.declared = true;
+            access.resource_writes.set(T::get_id());
+        }
+
+        T *get() const {
+            return resource;
+        }
+
+        T *operator->() const {
+            return resource;
+        }
+
+        T &operator*() const {
+            return *resource;
+        }
+
+        explicit operator bool() const {
+            return resource != nullptr;
+        }
+    private:
+        T *resource;
+};
+
 class SystemBase {
     protected:
         static u32 id_counter;
@@ -15,18 +120,27 @@ class SystemBase {
         static u32 get_id();
         Query queries[4];
         u32 query_count;
+        SystemAccess access;
 
         SystemBase() {
         }
-};
 
-class ECS;
+        virtual ~SystemBase() {
+        }
 
-template <typename T>
+        // Called by the scheduler, forwards to the update of the concrete system.
+        virtual void run(ECS &ecs) = 0;
+};
+
+template <typename T, typename... Accesses>
 class System: public SystemBase {
     private:
 
     public:
+        System() {
+            (Accesses::declare(access), ...);
+        }
+
         static u32 get_id() {
             static u32 id = id_counter++;
             if (id >= MAX_SYSTEMS) {
@@ -37,6 +151,10 @@ class System: public SystemBase {
 
         bool update(ECS &ecs);
 
+        void run(ECS &ecs) override {
+            static_cast<T*>(this)->update(ecs);
+        }
+
         Query *get_query(u32 index) {
             return &queries[index];
         }
@@ -1,7 +1,12 @@
 #include "systemmanager.hpp"
+#include "ecs.hpp"
 
-SystemManager::SystemManager() {
+SystemManager::SystemManager(JobPool *job_pool) {
+    this->job_pool = job_pool;
     system_count = 0;
+    update_stamp = 0;
+    schedule_dirty = true;
+    running_ecs = nullptr;
 }
 
 SystemManager::~SystemManager() {
@@ -10,37 +15,97 @@ SystemManager::~SystemManager() {
     }
 }
 
-void SystemManager::destroy_entity(Entity entity) {
-    for (u32 i = 0; i < system_count; i++) {
-        SystemBase *system = systems[i];
-        // Iterate through every query in system
-        for (u32 j = 0; j < system->query_count; j++) {
-            Query *query = &system->queries[j];
-            // Check if entity is in query
-            if (query->entities.is_in(entity)) {
-                // Remove entity from query
-                query->entities.remove(entity);
+void SystemManager::index_queries(SystemBase *system) {
+    for (u32 j = 0; j < system->query_count; j++) {
+        Query *query = &system->queries[j];
+        Signature query_signature = query->get_signature();
+        if (query_signature.none()) {
+            unfiltered_queries.push_back(query);
+            continue;
+        }
+        for (ComponentID id = 0; id < MAX_COMPONENTS; id++) {
+            if (query_signature.test(id)) {
+                component_queries[id].push_back(query);
             }
         }
     }
 }
 
-void SystemManager::update_components(Entity entity, Signature signature) {
+void SystemManager::create_entity(Entity entity) {
+    for (Query *query : unfiltered_queries) {
+        query->entities.insert(entity);
+    }
+}
+
+void SystemManager::destroy_entity(Entity entity, Signature signature) {
+    for (Query *query : unfiltered_queries) {
+        query->entities.remove(entity);
+    }
+    // The entity can only be in queries mentioning one of its components.
+    for_each_affected_query(signature, [&](Query *query) {
+        query->entities.remove(entity);
+    });
+}
+
+void SystemManager::update_components(Entity entity, Signature old_signature, Signature new_signature) {
+    for_each_affected_query(old_signature ^ new_signature, [&](Query *query) {
+        if (new_signature.contains(query->get_signature())) {
+            query->entities.insert(entity);
+        } else {
+            query->entities.remove(entity);
+        }
+    });
+}
+
+void SystemManager::build_schedule() {
     for (u32 i = 0; i < system_count; i++) {
-        SystemBase *system = systems[i];
-        for (u32 j = 0; j < system->query_count; j++) {
-            Query *query = &system->queries[j];
-            Signature query_signature = query->get_signature();
-            if ((signature & query_signature) == query_signature) {
-                INFO("Added entity {} to query, {}", entity, j);
-                // Entity matches query
-                query->entities.insert(entity);
-            } else {
-                INFO("Removed entity {} from query ", entity);
-                // Entity does not match query
-                query->entities.remove(entity);
+        dependency_counts[i] = 0;
+        dependents[i].clear();
+    }
+    for (u32 i = 0; i < system_count; i++) {
+        for (u32 j = i + 1; j < system_count; j++) {
+            if (systems[i]->access.conflicts_with(systems[j]->access)) {
+                dependents[i].push_back(j);
+                dependency_counts[j]++;
             }
         }
     }
+    schedule_dirty = false;
 }
 
+void SystemManager::run_system(void *context, u32 system_index) {
+    SystemManager *manager = (SystemManager*)context;
+    SystemBase *system = manager->systems[system_index];
+    system->run(*manager->running_ecs);
+
+    // Writes made by the system itself are stamped at most with this tick, so its filters only
+    // see what changed afterwards.
+    u32 last_run_tick = manager->running_ecs->advance_change_tick();
+    for (u32 i = 0; i < system->query_count; i++) {
+        system->queries[i].last_run_tick = last_run_tick;
+    }
+
+    // Start the systems that were only waiting for this one.
+    for (u32 dependent : manager->dependents[system_index]) {
+        if (manager->remaining_dependencies[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            manager->job_pool->push({ run_system, manager, dependent, &manager->pending_systems });
+        }
+    }
+}
+
+void SystemManager::update(ECS &ecs) {
+    if (schedule_dirty) build_schedule();
+
+    running_ecs = &ecs;
+    pending_systems.store(system_count, std::memory_order_relaxed);
+    for (u32 i = 0; i < system_count; i++) {
+        remaining_dependencies[i].store(dependency_counts[i], std::memory_order_relaxed);
+    }
+    for (u32 i = 0; i < system_count; i++) {
+        if (dependency_counts[i] == 0) {
+            job_pool->push({ run_system, this, i, &pending_systems });
+        }
+    }
+    job_pool->wait(pending_systems);
+    running_ecs = nullptr;
+}
@@ -1,22 +1,33 @@
+#pragma once
+
 #include "engine/ecs/entity.hpp"
+#include "engine/ecs/jobpool.hpp"
 #include "engine/ecs/system.hpp"
+#include <atomic>
+#include <vector>
+
 class SystemManager {
     public:
-        SystemManager();
+        SystemManager(JobPool *job_pool);
 
         ~SystemManager();
 
         template <typename T>
             T* register_system() {
                 systems[system_count] = new T();
-                signatures[system_count] = 0;
+                signatures[system_count] = Signature();
+                index_queries(systems[system_count]);
                 system_count++;
+                schedule_dirty = true;
                 return (T*)systems[system_count - 1];
             }
 
-        void destroy_entity(Entity entity);
+        void create_entity(Entity entity);
+
+        void destroy_entity(Entity entity, Signature signature);
 
-        void update_components(Entity entity, Signature signature);
+        // Only re-tests the queries that mention a component that differs between the signatures.
+        void update_components(Entity entity, Signature old_signature, Signature new_signature);
 
         template <typename T>
         void set_signature(Signature signature) {
@@ -24,12 +35,54 @@ class SystemManager {
             signatures[system_id] = signature;
         }
 
-        void update();
+        // Runs every system once. Systems whose accesses conflict run in registration order,
+        // the others run in parallel on the job pool.
+        void update(ECS &ecs);
     private:
         SystemBase *systems[MAX_SYSTEMS];
         Signature signatures[MAX_SYSTEMS];
         u32 system_count;
 
+        // Queries that mention each component id, and queries without components which match
+        // every entity.
+        std::vector<Query*> component_queries[MAX_COMPONENTS];
+        std::vector<Query*> unfiltered_queries;
+        // Makes sure a query mentioning several changed components is only tested once per update.
+        u32 update_stamp;
+
+        // Dependency graph between systems, rebuilt when a system is registered. A system
+        // depends on every earlier system it conflicts with.
+        JobPool *job_pool;
+        bool schedule_dirty;
+        u32 dependency_counts[MAX_SYSTEMS];
+        std::vector<u32> dependents[MAX_SYSTEMS];
+        std::atomic<u32> remaining_dependencies[MAX_SYSTEMS];
+        std::atomic<u32> pending_systems;
+        ECS *running_ecs;
+
+        void index_queries(SystemBase *system);
+
+        void build_schedule();
+
+        static void run_system(void *context, u32 system_index);
+
+        template <typename Fn>
+        void for_each_affected_query(Signature changed, Fn fn) {
+            update_stamp++;
+            for (u32 word = 0; word < SIGNATURE_WORDS; word++) {
+                u64 bits = changed.words[word];
+                while (bits != 0) {
+                    u32 component_id = word * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    for (Query *query : component_queries[component_id]) {
+                        if (query->update_stamp == update_stamp) continue;
+                        query->update_stamp = update_stamp;
+                        fn(query);
+                    }
+                }
+            }
+        }
+
         template <typename T>
             System<T> *get_system(u32 system_id) {
                 return (System<T>*)systems[system_id];
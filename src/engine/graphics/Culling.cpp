@@ -0,0 +1,168 @@
+#include "Culling.h"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+namespace engine {
+
+Frustum Frustum::from_view_projection(const glm::mat4& view_projection) {
+    // Rows of the matrix, glm is column major.
+    glm::vec4 rows[4];
+    for (u32 i = 0; i < 4; ++i) {
+        rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i],
+                            view_projection[3][i]);
+    }
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];  // Left
+    frustum.planes[1] = rows[3] - rows[0];  // Right
+    frustum.planes[2] = rows[3] + rows[1];  // Bottom
+    frustum.planes[3] = rows[3] - rows[1];  // Top
+    frustum.planes[4] = rows[3] + rows[2];  // Near
+    frustum.planes[5] = rows[3] - rows[2];  // Far
+    for (auto& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+void FrustumCuller::clear() {
+    m_center_x.clear();
+    m_center_y.clear();
+    m_center_z.clear();
+    m_extent_x.clear();
+    m_extent_y.clear();
+    m_extent_z.clear();
+}
+
+u32 FrustumCuller::push(const glm::vec3& local_min, const glm::vec3& local_max,
+                        const glm::mat4& world) {
+    glm::vec3 local_center = (local_min + local_max) * 0.5f;
+    glm::vec3 local_extent = (local_max - local_min) * 0.5f;
+
+    // The extent of the transformed box along an axis is the sum of the absolute values of the
+    // transformed half extents projected onto that axis (Arvo).
+    glm::vec3 center = glm::vec3(world[3]) + glm::vec3(world[0]) * local_center.x +
+                       glm::vec3(world[1]) * local_center.y + glm::vec3(world[2]) * local_center.z;
+    glm::vec3 extent = glm::abs(glm::vec3(world[0])) * local_extent.x +
+                       glm::abs(glm::vec3(world[1])) * local_extent.y +
+                       glm::abs(glm::vec3(world[2])) * local_extent.z;
+
+    u32 index = m_center_x.size();
+    m_center_x.push_back(center.x);
+    m_center_y.push_back(center.y);
+    m_center_z.push_back(center.z);
+    m_extent_x.push_back(extent.x);
+    m_extent_y.push_back(extent.y);
+    m_extent_z.push_back(extent.z);
+    return index;
+}
+
+// A box is outside when it lies entirely behind one of the planes, that is when even the corner
+// furthest along the plane normal is behind it.
+static bool box_visible(const Frustum& frustum, glm::vec3 center, glm::vec3 extent) {
+    for (const auto& plane : frustum.planes) {
+        glm::vec3 normal = glm::vec3(plane);
+        f32 distance = glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extent);
+        if (distance < 0.0f) return false;
+    }
+    return true;
+}
+
+u32 FrustumCuller::cull(const Frustum& frustum, std::vector<u8>& visible) const {
+    u32 count = size();
+    visible.resize(count);
+
+    u32 visible_count = 0;
+    u32 i = 0;
+#ifdef CULLING_SSE
+    __m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+    __m128 abs_x[6], abs_y[6], abs_z[6];
+    for (u32 p = 0; p < 6; ++p) {
+        const auto& plane = frustum.planes[p];
+        plane_x[p] = _mm_set1_ps(plane.x);
+        plane_y[p] = _mm_set1_ps(plane.y);
+        plane_z[p] = _mm_set1_ps(plane.z);
+        plane_w[p] = _mm_set1_ps(plane.w);
+        abs_x[p] = _mm_set1_ps(std::abs(plane.x));
+        abs_y[p] = _mm_set1_ps(std::abs(plane.y));
+        abs_z[p] = _mm_set1_ps(std::abs(plane.z));
+    }
+
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 cx = _mm_loadu_ps(&m_center_x[i]);
+        __m128 cy = _mm_loadu_ps(&m_center_y[i]);
+        __m128 cz = _mm_loadu_ps(&m_center_z[i]);
+        __m128 ex = _mm_loadu_ps(&m_extent_x[i]);
+        __m128 ey = _mm_loadu_ps(&m_extent_y[i]);
+        __m128 ez = _mm_loadu_ps(&m_extent_z[i]);
+
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (u32 p = 0; p < 6; ++p) {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(cx, plane_x[p]), plane_w[p]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(cy, plane_y[p]));
+            distance = _mm_add_ps(distance, _mm_mul_ps(cz, plane_z[p]));
+            distance = _mm_add_ps(distance, _mm_mul_ps(ex, abs_x[p]));
+            distance = _mm_add_ps(distance, _mm_mul_ps(ey, abs_y[p]));
+            distance = _mm_add_ps(distance, _mm_mul_ps(ez, abs_z[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+        }
+
+        u32 mask = _mm_movemask_ps(inside);
+        for (u32 lane = 0; lane < 4; ++lane) {
+            u8 lane_visible = (mask >> lane) & 1;
+            visible[i + lane] = lane_visible;
+            visible_count += lane_visible;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        glm::vec3 center(m_center_x[i], m_center_y[i], m_center_z[i]);
+        glm::vec3 extent(m_extent_x[i], m_extent_y[i], m_extent_z[i]);
+        visible[i] = box_visible(frustum, center, extent);
+        visible_count += visible[i];
+    }
+
+    return visible_count;
+}
+
+void MeshletCuller::set_instance(const Frustum& frustum, const glm::vec3& camera_pos,
+                                 const glm::mat4& world) {
+    // dot(plane, world * p) = dot(transpose(world) * plane, p). The side of a plane a point is on
+    // does not change with an affine transform, so the sphere test is exact in local space once the
+    // planes are normalized again.
+    glm::mat4 transposed = glm::transpose(world);
+    for (u32 p = 0; p < 6; ++p) {
+        glm::vec4 plane = transposed * frustum.planes[p];
+        m_local_frustum.planes[p] = plane / glm::length(glm::vec3(plane));
+    }
+
+    glm::vec4 local_camera = glm::inverse(world) * glm::vec4(camera_pos, 1.0f);
+    m_local_camera_pos = glm::vec3(local_camera);
+
+    glm::vec3 x = glm::vec3(world[0]), y = glm::vec3(world[1]), z = glm::vec3(world[2]);
+    m_cone_culling = glm::dot(glm::cross(x, y), z) > 0.0f;
+}
+
+bool MeshletCuller::frustum_visible(const glm::vec3& center, f32 radius) const {
+    for (const auto& plane : m_local_frustum.planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    }
+    return true;
+}
+
+bool MeshletCuller::cone_visible(const glm::vec3& center, f32 radius, const glm::vec3& cone_axis,
+                                 f32 cone_cutoff) const {
+    if (!m_cone_culling) return true;
+    // The camera is behind all triangles when the direction to every point of the sphere is
+    // within 90 degrees minus the cone angle of the axis.
+    glm::vec3 to_center = center - m_local_camera_pos;
+    return glm::dot(to_center, cone_axis) < cone_cutoff * glm::length(to_center) + radius;
+}
+
+};  // namespace engine
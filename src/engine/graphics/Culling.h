@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../core.h"
+
+namespace engine {
+
+// Planes point inwards, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all six.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Extracts the planes from a projection * view matrix (Gribb and Hartmann).
+    static Frustum from_view_projection(const glm::mat4& view_projection);
+};
+
+// World space boxes in structure of arrays form, so four boxes can be tested against a plane
+// with a handful of SSE instructions.
+class FrustumCuller {
+   public:
+    void clear();
+    // Transforms the local box by the world matrix and adds the world space box enclosing it,
+    // returns the index of the box.
+    u32 push(const glm::vec3& local_min, const glm::vec3& local_max, const glm::mat4& world);
+    // Sets visible[i] to 1 when box i intersects or is inside the frustum, 0 otherwise. Returns
+    // the number of visible boxes.
+    u32 cull(const Frustum& frustum, std::vector<u8>& visible) const;
+
+    u32 size() const { return m_center_x.size(); }
+
+    std::vector<f32> m_center_x;
+    std::vector<f32> m_center_y;
+    std::vector<f32> m_center_z;
+    std::vector<f32> m_extent_x;
+    std::vector<f32> m_extent_y;
+    std::vector<f32> m_extent_z;
+};
+
+// Tests meshlets of one instance at a time. The frustum and the camera are moved into the local
+// space of the instance instead of moving every meshlet into world space.
+class MeshletCuller {
+   public:
+    void set_instance(const Frustum& frustum, const glm::vec3& camera_pos, const glm::mat4& world);
+
+    // False when the bounding sphere is outside the frustum.
+    bool frustum_visible(const glm::vec3& center, f32 radius) const;
+    // False when every triangle inside the bounding sphere with normals inside the cone faces away
+    // from the camera (Meshlet::cone_axis and Meshlet::cone_cutoff).
+    bool cone_visible(const glm::vec3& center, f32 radius, const glm::vec3& cone_axis,
+                      f32 cone_cutoff) const;
+
+   private:
+    Frustum m_local_frustum;
+    glm::vec3 m_local_camera_pos;
+    // A mirroring world matrix flips the winding, the cones can not be used then.
+    bool m_cone_culling;
+};
+
+};  // namespace engine
@@ -1,6 +1,7 @@
 #include "Image.h"
 
 #include <cassert>
+#include <cstdint>
 #include <glad/glad.h>
 
 namespace engine {
@@ -67,6 +68,7 @@ void Image::init(const ImageInfo &info) {
     glCreateTextures(texture_target, 1, &m_handle);
     glTextureStorage2D(m_handle, info.num_levels, format, info.width, info.height);
     m_info = info;
+    m_resident = false;
 }
 
 void Image::deinit() {
@@ -74,6 +76,7 @@ void Image::deinit() {
 }
 
 void Image::upload(u8 *data) {
+    m_resident = true;
     if (m_info.is_cubemap) {
         if (m_info.is_compressed) {
             upload_cubemap_compressed(data);
@@ -109,6 +112,13 @@ void Image::upload(u8 *data) {
     }
 }
 
+void Image::upload_from_buffer(u32 buffer, u64 offset) {
+    // With a bound unpack buffer the data pointers are offsets into it.
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    upload((u8 *)(uintptr_t)offset);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
 void Image::upload_compressed(u8 *data) {
     u32 format = to_opengl_format_external(m_info.format);
 
@@ -10,10 +10,14 @@ public:
     void init(const ImageInfo& image_info);
     void deinit();
     void upload(u8* data);
+    // Uploads the bytes at offset in a pixel unpack buffer instead of client memory.
+    void upload_from_buffer(u32 buffer, u64 offset);
 
 
     u32 m_handle;
     ImageInfo m_info;
+    // Set once the contents have been uploaded, the storage is undefined before.
+    bool m_resident;
 private:
     void upload_compressed(u8* data);
     void upload_cubemap(u8* data);
@@ -45,16 +45,53 @@ u32 static load_shader_binary(const char* path, u32 shader_type, std::span<u32>
     return shader;
 }
 
-u32 static load_shader(const char* path, u32 shader_type) {
+static bool preprocess_shader(const std::string& path, std::span<const std::string> defines,
+                              u32 depth, std::string& out) {
+    if (depth > 16) {
+        ERROR("Shader includes nested too deep in {}", path);
+        return false;
+    }
+
     std::ifstream file(path);
     if (!file.is_open()) {
         ERROR("Failed to open shader file at {}", path);
-        return UINT32_MAX;
+        return false;
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string src = buffer.str();
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && line.compare(first, 8, "#include") == 0) {
+            size_t name_start = line.find('"', first);
+            size_t name_end = line.find('"', name_start + 1);
+            if (name_start == std::string::npos || name_end == std::string::npos) {
+                ERROR("Malformed include in {}: {}", path, line);
+                return false;
+            }
+            std::string include_path = directory + line.substr(name_start + 1, name_end - name_start - 1);
+            if (!preprocess_shader(include_path, {}, depth + 1, out)) return false;
+            continue;
+        }
+
+        out += line;
+        out += '\n';
+        if (first != std::string::npos && line.compare(first, 8, "#version") == 0) {
+            for (const auto& define : defines) {
+                out += "#define ";
+                out += define;
+                out += '\n';
+            }
+        }
+    }
+    return true;
+}
+
+u32 static load_shader(const char* path, u32 shader_type, std::span<const std::string> defines) {
+    std::string src;
+    if (!preprocess_shader(path, defines, 0, src)) {
+        return UINT32_MAX;
+    }
     const char* source = src.c_str();
     GLint length = src.length();
 
@@ -78,6 +115,15 @@ u32 static load_shader(const char* path, u32 shader_type) {
 void Pipeline::init() {
     glCreateVertexArrays(1, &m_vao);
     m_program = glCreateProgram();
+    m_shares_vertex_array = false;
+}
+
+void Pipeline::init_shared(const Pipeline& other) {
+    m_vao = other.m_vao;
+    m_vbo = other.m_vbo;
+    m_ibo = other.m_ibo;
+    m_program = glCreateProgram();
+    m_shares_vertex_array = true;
 }
 
 void Pipeline::deinit() {
@@ -85,6 +131,7 @@ void Pipeline::deinit() {
     glBindVertexArray(0);
     glUseProgram(0);
     glDeleteProgram(m_program);
+    if (m_shares_vertex_array) return;
     glDeleteBuffers(1, &m_vbo);
     glDeleteBuffers(1, &m_ibo);
 }
@@ -97,12 +144,12 @@ void Pipeline::add_fragment_shader(const std::string& path, std::span<u32> speci
     m_fshader = load_shader_binary(path.c_str(), GL_FRAGMENT_SHADER, specialization_constants);
 }
 
-void Pipeline::add_vertex_shader_src(const std::string& path) {
-    m_vshader = load_shader(path.c_str(), GL_VERTEX_SHADER);
+void Pipeline::add_vertex_shader_src(const std::string& path, std::span<const std::string> defines) {
+    m_vshader = load_shader(path.c_str(), GL_VERTEX_SHADER, defines);
 }
 
-void Pipeline::add_fragment_shader_src(const std::string& path) {
-    m_fshader = load_shader(path.c_str(), GL_FRAGMENT_SHADER);
+void Pipeline::add_fragment_shader_src(const std::string& path, std::span<const std::string> defines) {
+    m_fshader = load_shader(path.c_str(), GL_FRAGMENT_SHADER, defines);
 }
 
 void Pipeline::compile() {
@@ -137,15 +184,30 @@ void Pipeline::add_vertex_buffer(std::span<const VertexAttributeDescriptor> attr
     for (size_t i = 0; i < attributes.size(); ++i) {
         const auto& attrib = attributes[i];
         u32 gl_type;
+        bool normalized = false;
         switch (attrib.type) {
             case VertexAttributeDescriptor::Type::f32: {
                 gl_type = GL_FLOAT;
                 break;
             }
+            case VertexAttributeDescriptor::Type::f16: {
+                gl_type = GL_HALF_FLOAT;
+                break;
+            }
+            case VertexAttributeDescriptor::Type::unorm16: {
+                gl_type = GL_UNSIGNED_SHORT;
+                normalized = true;
+                break;
+            }
+            case VertexAttributeDescriptor::Type::snorm16: {
+                gl_type = GL_SHORT;
+                normalized = true;
+                break;
+            }
             default: assert(0);
         }
 
-        glVertexArrayAttribFormat(m_vao, i, attrib.count, gl_type, GL_FALSE, attrib.offset);
+        glVertexArrayAttribFormat(m_vao, i, attrib.count, gl_type, normalized, attrib.offset);
         glVertexArrayAttribBinding(m_vao, i, 0);
         glEnableVertexArrayAttrib(m_vao, i);
     }
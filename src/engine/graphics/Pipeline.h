@@ -11,6 +11,10 @@ namespace engine {
 struct VertexAttributeDescriptor {
     enum class Type : u32 {
         f32,
+        f16,
+        // Normalized to [0, 1] and [-1, 1] when read by the shader.
+        unorm16,
+        snorm16,
     };
 
     Type type;
@@ -24,6 +28,12 @@ struct VertexAttributeDescriptor {
                 type_size = 4;
                 break;
             }
+            case Type::f16:
+            case Type::unorm16:
+            case Type::snorm16: {
+                type_size = 2;
+                break;
+            }
             default: assert(0);
         }
         return type_size * count;
@@ -35,6 +45,9 @@ class Pipeline {
 public:
     // Use this instead of constructor.
     void init();
+    // Same as init but draws from the vertex array, and so the vertex and index buffers, of
+    // another pipeline. Only the shaders are added to this one.
+    void init_shared(const Pipeline& other);
     void deinit();
 
     void add_vertex_buffer(std::span<const VertexAttributeDescriptor> attributes, u32 stride, std::span<u8> vertex_data);
@@ -45,9 +58,10 @@ public:
     void bind();
 
 
-    // Will disappear
-    void add_vertex_shader_src(const std::string& path);
-    void add_fragment_shader_src(const std::string& path);
+    // Compiles GLSL at runtime. #include "file" is resolved relative to the including file, like
+    // glslc does, and every define is added after the #version line.
+    void add_vertex_shader_src(const std::string& path, std::span<const std::string> defines = {});
+    void add_fragment_shader_src(const std::string& path, std::span<const std::string> defines = {});
 
     u32 m_program;
     u32 m_vao;
@@ -56,6 +70,7 @@ public:
     u32 m_ibo;
     u32 m_vshader;
     u32 m_fshader;
+    bool m_shares_vertex_array;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace engine {
+
+u64 SortKey::make(u32 pipeline, u32 material, u32 mesh, u32 lod, f32 depth) {
+    // Primitives that alias in the key would interleave after sorting and break instancing.
+    assert(mesh < (1u << mesh_bits));
+    // The bit pattern of a positive float increases with its value, so the top bits of it are a
+    // quantized depth that sorts correctly as an integer.
+    depth = std::max(depth, 0.0f);
+    u32 depth_bits_value;
+    std::memcpy(&depth_bits_value, &depth, sizeof(depth_bits_value));
+    u64 quantized_depth = depth_bits_value >> (32 - depth_bits);
+
+    return ((u64)(pipeline & ((1u << pipeline_bits) - 1)) << pipeline_shift) |
+           ((u64)(material & ((1u << material_bits) - 1)) << material_shift) |
+           ((u64)(mesh & ((1u << mesh_bits) - 1)) << mesh_shift) |
+           ((u64)(lod & ((1u << lod_bits) - 1)) << lod_shift) |
+           (quantized_depth << depth_shift);
+}
+
+void RenderQueue::clear() {
+    m_items.clear();
+    m_transforms.clear();
+}
+
+u32 RenderQueue::push_transform(const glm::mat4& transform) {
+    u32 index = m_transforms.size();
+    m_transforms.push_back(transform);
+    return index;
+}
+
+void RenderQueue::push(u64 sort_key, u32 primitive_index, u32 transform_index) {
+    m_items.push_back({
+        .sort_key = sort_key,
+        .primitive_index = primitive_index,
+        .transform_index = transform_index,
+    });
+}
+
+void RenderQueue::sort() {
+    u32 count = m_items.size();
+    if (count < 2) return;
+    m_scratch.resize(count);
+
+    DrawItem* src = m_items.data();
+    DrawItem* dst = m_scratch.data();
+    for (u32 shift = 0; shift < 64; shift += 8) {
+        u32 offsets[256] = {};
+        for (u32 i = 0; i < count; ++i) {
+            offsets[(src[i].sort_key >> shift) & 0xff]++;
+        }
+        if (offsets[(src[0].sort_key >> shift) & 0xff] == count) continue;
+
+        u32 sum = 0;
+        for (u32 bucket = 0; bucket < 256; ++bucket) {
+            u32 bucket_count = offsets[bucket];
+            offsets[bucket] = sum;
+            sum += bucket_count;
+        }
+        for (u32 i = 0; i < count; ++i) {
+            dst[offsets[(src[i].sort_key >> shift) & 0xff]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != m_items.data()) {
+        std::memcpy(m_items.data(), src, count * sizeof(DrawItem));
+    }
+}
+
+};  // namespace engine
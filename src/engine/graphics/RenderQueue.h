@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../core.h"
+
+namespace engine {
+
+// One primitive to draw. Items are sorted by key, so draws sharing state end up next to each
+// other and the renderer only has to change state when the key bits above the depth change.
+struct DrawItem {
+    u64 sort_key;
+    u32 primitive_index;
+    u32 transform_index;
+};
+
+// Sort key layout from the most to the least significant bits.
+struct SortKey {
+    static constexpr u32 pipeline_bits = 8;
+    static constexpr u32 material_bits = 16;
+    // The primitive index, scenes can have more primitives than materials.
+    static constexpr u32 mesh_bits = 24;
+    static constexpr u32 lod_bits = 2;
+    // Exponent and 5 mantissa bits of the depth, within a few percent is enough for front to
+    // back ordering.
+    static constexpr u32 depth_bits = 14;
+
+    static constexpr u32 depth_shift = 0;
+    static constexpr u32 lod_shift = depth_shift + depth_bits;
+    static constexpr u32 mesh_shift = lod_shift + lod_bits;
+    static constexpr u32 material_shift = mesh_shift + mesh_bits;
+    static constexpr u32 pipeline_shift = material_shift + material_bits;
+
+    // Opaque draws within the same state are ordered front to back by the view space depth.
+    // Draws of the same mesh and level of detail are adjacent, so they can be instanced.
+    static u64 make(u32 pipeline, u32 material, u32 mesh, u32 lod, f32 depth);
+
+    static u32 pipeline(u64 key) { return (key >> pipeline_shift) & ((1u << pipeline_bits) - 1); }
+    static u32 material(u64 key) { return (key >> material_shift) & ((1u << material_bits) - 1); }
+    static u32 mesh(u64 key) { return (key >> mesh_shift) & ((1u << mesh_bits) - 1); }
+    static u32 lod(u64 key) { return (key >> lod_shift) & ((1u << lod_bits) - 1); }
+};
+
+// Draws recorded during a pass. Building and sorting the queue does not touch OpenGL so it can
+// be run without a context.
+class RenderQueue {
+   public:
+    void clear();
+    u32 push_transform(const glm::mat4& transform);
+    void push(u64 sort_key, u32 primitive_index, u32 transform_index);
+    // Stable LSD radix sort on the key, 8 bits per pass. Passes where every item has the same
+    // byte are skipped, so keys that only use a few bits sort in a few passes.
+    void sort();
+
+    u32 size() const { return m_items.size(); }
+
+    std::vector<DrawItem> m_items;
+    std::vector<glm::mat4> m_transforms;
+
+   private:
+    std::vector<DrawItem> m_scratch;
+};
+
+};  // namespace engine
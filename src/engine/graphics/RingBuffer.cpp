@@ -0,0 +1,34 @@
+#include "RingBuffer.h"
+
+#include <glad/glad.h>
+
+namespace engine {
+
+u8* GLRingBackend::create(u32 size) {
+    u32 flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &handle);
+    glNamedBufferStorage(handle, size, nullptr, flags);
+    return (u8*)glMapNamedBufferRange(handle, 0, size, flags);
+}
+
+void GLRingBackend::destroy() {
+    glUnmapNamedBuffer(handle);
+    glDeleteBuffers(1, &handle);
+    handle = 0;
+}
+
+void* GLRingBackend::insert_fence() {
+    return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void GLRingBackend::wait_fence(void* fence) {
+    while (glClientWaitSync((GLsync)fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) ==
+           GL_TIMEOUT_EXPIRED) {
+    }
+}
+
+void GLRingBackend::delete_fence(void* fence) {
+    glDeleteSync((GLsync)fence);
+}
+
+};  // namespace engine
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cassert>
+
+#include "../core.h"
+
+namespace engine {
+
+// Persistently mapped OpenGL buffer with fences, the backend of the renderer's RingBuffer.
+struct GLRingBackend {
+    u32 handle = 0;
+
+    // Creates the buffer and returns the mapped memory.
+    u8* create(u32 size);
+    void destroy();
+    void* insert_fence();
+    void wait_fence(void* fence);
+    void delete_fence(void* fence);
+};
+
+// Bump allocator over a buffer the GPU reads from. Every frame allocates behind the previous one
+// and wraps around at the end, a fence inserted at the end of the frame tells when its bytes can
+// be reused. The allocator only waits when it catches up with data of a frame still in flight, or
+// when frames_in_flight frames are already queued.
+//
+// The backend owns the memory and the fences, see GLRingBackend. It is a template parameter so the
+// bookkeeping can be exercised without a GPU.
+template <typename Backend>
+class RingBuffer {
+   public:
+    static constexpr u32 frames_in_flight = 3;
+    static constexpr u32 allocation_failed = UINT32_MAX;
+
+    void init(u32 capacity, u32 alignment) {
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+        m_mapped = m_backend.create(capacity);
+        m_capacity = capacity;
+        m_alignment = alignment;
+        m_head = 0;
+        m_used = 0;
+        m_frame_bytes = 0;
+        m_oldest_frame = 0;
+        m_frame_count = 0;
+    }
+
+    // Waits for every frame in flight.
+    void deinit() {
+        while (m_frame_count > 0) {
+            retire_oldest_frame();
+        }
+        m_backend.destroy();
+        m_mapped = nullptr;
+    }
+
+    // Allocates size bytes for the current frame and returns the offset of them in the buffer,
+    // or allocation_failed when the frame does not fit in the buffer at all.
+    u32 allocate(u32 size) {
+        u32 offset = (m_head + m_alignment - 1) & ~(m_alignment - 1);
+        if (offset + size > m_capacity) {
+            // Skip the end of the buffer, the allocation has to be contiguous.
+            offset = 0;
+        }
+        // The bytes skipped for alignment or wrapping belong to this frame as well.
+        u32 consumed = (offset >= m_head ? offset - m_head : m_capacity - m_head) + size;
+
+        while (m_used + consumed > m_capacity) {
+            if (m_frame_count == 0) return allocation_failed;
+            retire_oldest_frame();
+        }
+
+        m_head = offset + size;
+        m_used += consumed;
+        m_frame_bytes += consumed;
+        return offset;
+    }
+
+    // Fences the allocations of the frame. Blocks while frames_in_flight frames are queued.
+    void end_frame() {
+        if (m_frame_count == frames_in_flight) {
+            retire_oldest_frame();
+        }
+        u32 frame = (m_oldest_frame + m_frame_count) % frames_in_flight;
+        m_frames[frame] = {
+            .fence = m_backend.insert_fence(),
+            .bytes = m_frame_bytes,
+        };
+        m_frame_count++;
+        m_frame_bytes = 0;
+    }
+
+    u8* data(u32 offset) const { return m_mapped + offset; }
+    u32 capacity() const { return m_capacity; }
+    u32 frames_queued() const { return m_frame_count; }
+    u32 bytes_used() const { return m_used; }
+
+    Backend m_backend;
+
+   private:
+    struct Frame {
+        void* fence;
+        u32 bytes;
+    };
+
+    void retire_oldest_frame() {
+        Frame& frame = m_frames[m_oldest_frame];
+        m_backend.wait_fence(frame.fence);
+        m_backend.delete_fence(frame.fence);
+        m_used -= frame.bytes;
+        m_oldest_frame = (m_oldest_frame + 1) % frames_in_flight;
+        m_frame_count--;
+    }
+
+    u8* m_mapped = nullptr;
+    u32 m_capacity = 0;
+    u32 m_alignment = 1;
+    // Where the next allocation starts, before alignment.
+    u32 m_head = 0;
+    // Bytes of queued frames and the current frame, including skipped bytes.
+    u32 m_used = 0;
+    u32 m_frame_bytes = 0;
+    Frame m_frames[frames_in_flight] = {};
+    u32 m_oldest_frame = 0;
+    u32 m_frame_count = 0;
+};
+
+};  // namespace engine
@@ -61,6 +61,14 @@ void Sampler::init(Filter mag_filter,
     u32 gl_address_mode_v = address_mode_to_opengl(address_mode_v);
     u32 gl_address_mode_w = address_mode_to_opengl(address_mode_w);
 
+    m_mag_filter = mag_filter;
+    m_min_filter = min_filter;
+    m_mipmap_mode = mipmap_mode;
+    m_address_mode_u = address_mode_u;
+    m_address_mode_v = address_mode_v;
+    m_address_mode_w = address_mode_w;
+    m_max_anisotropy = max_anisotropy;
+
     glCreateSamplers(1, &m_handle);
     glSamplerParameteri(m_handle, GL_TEXTURE_MAG_FILTER, gl_mag_filter);
     glSamplerParameteri(m_handle, GL_TEXTURE_MIN_FILTER, gl_min_filter);
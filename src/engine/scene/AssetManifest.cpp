@@ -4,23 +4,6 @@
 
 namespace engine {
 
-void AssetManifest::serialize(std::ofstream& out, u32& bytes_written) {
-    // Write the actual name data.
-    size_t size = sizeof(u8) * m_name_bytes.size();
-    out.write((const char*)m_name_bytes.data(), size);
-    bytes_written += size;
-
-    // Mesh names.
-    size = sizeof(Name) * m_mesh_names.size();
-    out.write((const char*)m_mesh_names.data(), size);
-    bytes_written += size;
-
-    // Prefab names.
-    size = sizeof(Name) * m_prefab_names.size();
-    out.write((const char*)m_prefab_names.data(), size);
-    bytes_written += size;
-}
-
 void AssetManifest::deserialize(std::span<u8> name_bytes, std::span<Name> mesh_names, std::span<Name> prefab_names) {
     m_name_bytes.assign(name_bytes.begin(), name_bytes.end());
     m_mesh_names.assign(mesh_names.begin(), mesh_names.end());
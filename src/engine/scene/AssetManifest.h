@@ -2,7 +2,7 @@
 
 #include <unordered_map>
 #include <vector>
-#include <fstream>
+#include <string>
 #include <string_view>
 #include <span>
 
@@ -19,7 +19,6 @@ class AssetManifest {
     };
 
 
-    void serialize(std::ofstream& out, u32& bytes_written);
     void deserialize(std::span<u8> name_bytes, std::span<Name> mesh_names, std::span<Name> prefab_names);
     Name create_name(std::string_view name);
 
@@ -1,5 +1,6 @@
 #include "Node.h"
 
+#include <cassert>
 #include <cstdint>
 #include <cstring>
 
@@ -9,12 +10,14 @@
 namespace engine {
 
 NodeHandle NodeHierarchy::add_root_node(const Node& node) {
+    m_layout_dirty = true;
     u32 node_index = m_nodes.size();
     m_nodes.push_back(node);
     return NodeHandle(node_index);
 }
 
 NodeHandle NodeHierarchy::add_node(const Node& node, NodeHandle parent) {
+    m_layout_dirty = true;
     u32 child_idx = m_nodes.size();
     m_nodes.push_back(node);
     m_nodes[parent.get_value()].children.push_back(child_idx);
@@ -52,6 +55,7 @@ std::vector<ImmutableNode> NodeHierarchy::to_immutable(AssetManifest& manifest,
 }
 
 NodeHandle NodeHierarchy::instantiate_prefab(const Scene& scene, const Prefab& prefab, NodeHandle parent_node) {
+    m_layout_dirty = true;
     u32 node_index = instantiate_prefab_node(scene, prefab.root_node_index);
     m_nodes[parent_node.get_value()].children.push_back(node_index);
 
@@ -80,4 +84,79 @@ u32 NodeHierarchy::instantiate_prefab_node(const Scene& scene, u32 node_index) {
     return our_node_index;
 }
 
+void NodeHierarchy::rebuild_transform_layout() {
+    m_transforms.clear();
+    m_slot_nodes.clear();
+    m_node_slots.assign(m_nodes.size(), TransformHierarchy::no_parent);
+    m_layout_dirty = false;
+    if (m_nodes.empty()) return;
+
+    // m_slot_nodes doubles as the queue of the breadth first traversal.
+    const Node& root = m_nodes[0];
+    m_slot_nodes.push_back(0);
+    m_node_slots[0] = 0;
+    m_transforms.push(TransformHierarchy::no_parent, root.translation, root.rotation, root.scale);
+
+    for (u32 slot = 0; slot < m_slot_nodes.size(); ++slot) {
+        const Node& node = m_nodes[m_slot_nodes[slot]];
+        m_transforms.m_first_child[slot] = m_slot_nodes.size();
+        m_transforms.m_child_count[slot] = node.children.size();
+
+        for (u32 child_index : node.children) {
+            const Node& child = m_nodes[child_index];
+            m_node_slots[child_index] = m_slot_nodes.size();
+            m_slot_nodes.push_back(child_index);
+            m_transforms.push(slot, child.translation, child.rotation, child.scale);
+        }
+    }
+}
+
+void NodeHierarchy::set_translation(NodeHandle handle, const glm::vec3& translation) {
+    const Node& node = m_nodes[handle.get_value()];
+    set_transform(handle, translation, node.rotation, node.scale);
+}
+
+void NodeHierarchy::set_rotation(NodeHandle handle, const glm::quat& rotation) {
+    const Node& node = m_nodes[handle.get_value()];
+    set_transform(handle, node.translation, rotation, node.scale);
+}
+
+void NodeHierarchy::set_scale(NodeHandle handle, const glm::vec3& scale) {
+    const Node& node = m_nodes[handle.get_value()];
+    set_transform(handle, node.translation, node.rotation, scale);
+}
+
+void NodeHierarchy::set_transform(NodeHandle handle, const glm::vec3& translation,
+                                  const glm::quat& rotation, const glm::vec3& scale) {
+    u32 node_index = handle.get_value();
+    Node& node = m_nodes[node_index];
+    node.translation = translation;
+    node.rotation = rotation;
+    node.scale = scale;
+
+    // Nodes added since the last layout, or not reachable from the root, get their transform
+    // from m_nodes once the layout is rebuilt.
+    if (m_layout_dirty || node_index >= m_node_slots.size()) return;
+    u32 slot = m_node_slots[node_index];
+    if (slot != TransformHierarchy::no_parent) {
+        m_transforms.set_local(slot, translation, rotation, scale);
+    }
+}
+
+void NodeHierarchy::update_world_transforms() {
+    // The editor adds children directly to m_nodes, so a changed node count also means a new layout.
+    if (m_layout_dirty || m_node_slots.size() != m_nodes.size()) {
+        rebuild_transform_layout();
+        m_transforms.update_world_matrices();
+    } else {
+        m_transforms.update_dirty_world_matrices();
+    }
+}
+
+const glm::mat4& NodeHierarchy::world_transform(NodeHandle handle) const {
+    u32 slot = m_node_slots[handle.get_value()];
+    assert(slot != TransformHierarchy::no_parent);
+    return m_transforms.m_world_matrices[slot];
+}
+
 }  // namespace engine
\ No newline at end of file
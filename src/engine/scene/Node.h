@@ -8,6 +8,7 @@
 #include "../core.h"
 #include "Scene.h"
 #include "AssetManifest.h"
+#include "Transforms.h"
 
 namespace engine {
 
@@ -46,6 +47,28 @@ class NodeHierarchy {
 
     NodeHandle instantiate_prefab(const Scene& scene, const Prefab& prefab, NodeHandle parent_node);
     u32 instantiate_prefab_node(const Scene& scene, u32 node_index);
+
+    // Local transforms have to be changed through these so that the subtree of the node is
+    // marked dirty, writing to m_nodes directly is not picked up by update_world_transforms.
+    void set_translation(NodeHandle handle, const glm::vec3& translation);
+    void set_rotation(NodeHandle handle, const glm::quat& rotation);
+    void set_scale(NodeHandle handle, const glm::vec3& scale);
+    void set_transform(NodeHandle handle, const glm::vec3& translation, const glm::quat& rotation,
+                       const glm::vec3& scale);
+
+    // Recomputes the cached world matrices of dirty subtrees, or of every node reachable from the
+    // root when nodes have been added since the last update.
+    void update_world_transforms();
+    const glm::mat4& world_transform(NodeHandle handle) const;
+
+    // Breadth first copy of the transforms, slot i holds the node m_slot_nodes[i].
+    TransformHierarchy m_transforms;
+    std::vector<u32> m_slot_nodes;
+    std::vector<u32> m_node_slots;
+    bool m_layout_dirty = true;
+
+   private:
+    void rebuild_transform_layout();
 };
 
 };  // namespace engine
\ No newline at end of file
@@ -11,6 +11,7 @@ void Scene::init(loader::AssetFileData& data) {
 
     m_meshes.assign(data.meshes.begin(), data.meshes.end());
     m_primitives.assign(data.primitives.begin(), data.primitives.end());
+    m_meshlets.assign(data.meshlets.begin(), data.meshlets.end());
     m_materials.assign(data.materials.begin(), data.materials.end());
     m_textures.assign(data.textures.begin(), data.textures.end());
     m_prefab_nodes.assign(data.prefab_nodes.begin(), data.prefab_nodes.end());
@@ -31,9 +32,9 @@ void Scene::init(loader::AssetFileData& data) {
     for (const auto& image_info : data.images) {
         Image image;
         image.init(image_info);
-        image.upload(&data.image_data[image_info.image_data_index]);
         m_images.push_back(image);
     }
+    m_num_resident_images = 0;
 }
 
 }
\ No newline at end of file
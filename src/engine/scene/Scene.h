@@ -25,6 +25,55 @@ struct Vertex {
     glm::vec2 uv;
 };
 
+// Vertex format of the asset file, 20 bytes instead of the 48 of Vertex. Decoded in
+// basic.vert.glsl.
+struct PackedVertex {
+    // Unorm16 position relative to the AABB of the primitive, w is the sign of the bitangent,
+    // 0 for -1 and 65535 for 1.
+    u16 pos[4];
+    // Snorm16 octahedral encoded unit vectors.
+    i16 normal[2];
+    i16 tangent[2];
+    // Half floats.
+    u16 uv[2];
+};
+
+
+// Computed by the asset processor from the vertex positions, in the space of the mesh.
+struct Bounds {
+    glm::vec3 aabb_min;
+    glm::vec3 aabb_max;
+    glm::vec3 sphere_center;
+    f32 sphere_radius;
+};
+
+// A cluster of at most max_meshlet_vertices vertices and max_meshlet_triangles triangles of a
+// primitive. The triangles are a contiguous range of the indices of the primitive.
+struct Meshlet {
+    glm::vec3 sphere_center;
+    f32 sphere_radius;
+    // The normals of all triangles are within cone_cutoff = sin(angle) of the axis, a cutoff of 1
+    // means the cone is too wide to cull with.
+    glm::vec3 cone_axis;
+    f32 cone_cutoff;
+    // Relative to the first index of the primitive.
+    u32 index_offset;
+    u32 num_triangles;
+};
+
+constexpr u32 max_meshlet_vertices = 64;
+constexpr u32 max_meshlet_triangles = 124;
+
+// A simplified version of a primitive indexing the same vertices, level 0 is the primitive itself.
+struct PrimitiveLod {
+    // Byte range in the index buffer, the index type is the one of the primitive.
+    u32 indices_start;
+    u32 indices_end;
+    // Object space distance between this level and the full primitive.
+    f32 error;
+};
+
+constexpr u32 max_primitive_lods = 4;
 
 struct MeshTag;
 using MeshHandle = TypedHandle<MeshTag>;
@@ -32,6 +81,7 @@ struct Mesh {
     u32 primitive_index;
     u32 num_primitives;
     u32 node_index;
+    Bounds bounds;
 };
 
 struct Primitive {
@@ -41,11 +91,22 @@ struct Primitive {
     u32 indices_end;
     u32 index_type;
     u32 material_index;
+    Bounds bounds;
+    u32 meshlet_index;
+    u32 num_meshlets;
+    // The meshlets are only of level 0.
+    PrimitiveLod lods[max_primitive_lods];
+    u32 num_lods;
 
     inline u32 num_indices() const {
         u32 len = indices_end - indices_start;
         return len / (index_type - 5121);
     }
+
+    inline u32 num_indices(u32 lod) const {
+        u32 len = lods[lod].indices_end - lods[lod].indices_start;
+        return len / (index_type - 5121);
+    }
 };
 
 struct ImmutableNode {
@@ -191,9 +252,13 @@ public:
     AssetManifest m_manifest;
     std::vector<Mesh> m_meshes;
     std::vector<Primitive> m_primitives;
+    std::vector<Meshlet> m_meshlets;
     std::vector<Material> m_materials;
     std::vector<Sampler> m_samplers;
     std::vector<Image> m_images;
+    // Images are created empty by init and uploaded by the AssetStreamer, the renderer draws
+    // placeholders for the ones that are not resident yet.
+    u32 m_num_resident_images;
     std::vector<TextureInfo> m_textures;
     std::vector<Prefab> m_prefabs;
     std::vector<ImmutableNode> m_prefab_nodes;
@@ -0,0 +1,139 @@
+#include "Transforms.h"
+
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TRANSFORMS_SSE 1
+#endif
+
+namespace engine {
+
+void TransformHierarchy::clear() {
+    m_translations.clear();
+    m_rotations.clear();
+    m_scales.clear();
+    m_parents.clear();
+    m_first_child.clear();
+    m_child_count.clear();
+    m_world_matrices.clear();
+    m_dirty.clear();
+    m_dirty_slots.clear();
+}
+
+u32 TransformHierarchy::push(u32 parent, const glm::vec3& translation, const glm::quat& rotation,
+                             const glm::vec3& scale) {
+    assert(parent == no_parent || parent < size());
+
+    u32 slot = size();
+    m_translations.push_back(translation);
+    m_rotations.push_back(rotation);
+    m_scales.push_back(scale);
+    m_parents.push_back(parent);
+    m_first_child.push_back(0);
+    m_child_count.push_back(0);
+    m_world_matrices.push_back(glm::mat4(1.0f));
+    m_dirty.push_back(0);
+    return slot;
+}
+
+void TransformHierarchy::set_local(u32 slot, const glm::vec3& translation,
+                                   const glm::quat& rotation, const glm::vec3& scale) {
+    m_translations[slot] = translation;
+    m_rotations[slot] = rotation;
+    m_scales[slot] = scale;
+    if (!m_dirty[slot]) {
+        m_dirty[slot] = 1;
+        m_dirty_slots.push_back(slot);
+    }
+}
+
+inline void TransformHierarchy::update_world_matrix(u32 slot) {
+    glm::mat4 local = compose_transform(m_translations[slot], m_rotations[slot], m_scales[slot]);
+    u32 parent = m_parents[slot];
+    if (parent == no_parent) {
+        m_world_matrices[slot] = local;
+    } else {
+        multiply_transforms(m_world_matrices[parent], local, m_world_matrices[slot]);
+    }
+}
+
+void TransformHierarchy::update_world_matrices() {
+    u32 count = size();
+    for (u32 slot = 0; slot < count; ++slot) {
+        update_world_matrix(slot);
+    }
+
+    for (u32 slot : m_dirty_slots) {
+        m_dirty[slot] = 0;
+    }
+    m_dirty_slots.clear();
+}
+
+void TransformHierarchy::update_dirty_world_matrices() {
+    // Ancestors have lower slots than their descendants, so after sorting every dirty subtree
+    // is updated before any dirty slot inside of it, and those are skipped.
+    std::sort(m_dirty_slots.begin(), m_dirty_slots.end());
+
+    for (u32 dirty_slot : m_dirty_slots) {
+        if (!m_dirty[dirty_slot]) continue;
+
+        // Children are contiguous but a subtree is not, walk it with a stack of slots.
+        m_stack.push_back(dirty_slot);
+        while (!m_stack.empty()) {
+            u32 slot = m_stack.back();
+            m_stack.pop_back();
+
+            update_world_matrix(slot);
+            m_dirty[slot] = 0;
+
+            u32 first_child = m_first_child[slot];
+            for (u32 child = first_child; child < first_child + m_child_count[slot]; ++child) {
+                m_stack.push_back(child);
+            }
+        }
+    }
+    m_dirty_slots.clear();
+}
+
+glm::mat4 compose_transform(const glm::vec3& translation, const glm::quat& rotation,
+                            const glm::vec3& scale) {
+    f32 xx = rotation.x * rotation.x;
+    f32 yy = rotation.y * rotation.y;
+    f32 zz = rotation.z * rotation.z;
+    f32 xy = rotation.x * rotation.y;
+    f32 xz = rotation.x * rotation.z;
+    f32 yz = rotation.y * rotation.z;
+    f32 wx = rotation.w * rotation.x;
+    f32 wy = rotation.w * rotation.y;
+    f32 wz = rotation.w * rotation.z;
+
+    glm::mat4 result;
+    result[0] = glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * scale.x;
+    result[1] = glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * scale.y;
+    result[2] = glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * scale.z;
+    result[3] = glm::vec4(translation, 1.0f);
+    return result;
+}
+
+void multiply_transforms(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#ifdef TRANSFORMS_SSE
+    // Column major, so every column of the result is a linear combination of the columns of a.
+    __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    __m128 a3 = _mm_loadu_ps(&a[3][0]);
+    for (u32 column = 0; column < 4; ++column) {
+        __m128 result = _mm_mul_ps(a0, _mm_set1_ps(b[column][0]));
+        result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(b[column][1])));
+        result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(b[column][2])));
+        result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(b[column][3])));
+        _mm_storeu_ps(&out[column][0], result);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+};  // namespace engine
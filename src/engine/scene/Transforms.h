@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+#include "../core.h"
+
+namespace engine {
+
+// Local and world transforms of a node hierarchy in structure of arrays form. Nodes are stored
+// in breadth first order, so every parent comes before its children and the children of a node
+// are contiguous. World matrices can then be computed in a single linear pass without recursion.
+class TransformHierarchy {
+   public:
+    static constexpr u32 no_parent = UINT32_MAX;
+
+    void clear();
+    // The parent has to be pushed before the child, returns the slot of the transform.
+    u32 push(u32 parent, const glm::vec3& translation, const glm::quat& rotation,
+             const glm::vec3& scale);
+    // Changes the local transform and marks the subtree of the slot as dirty.
+    void set_local(u32 slot, const glm::vec3& translation, const glm::quat& rotation,
+                   const glm::vec3& scale);
+    // Recomputes every world matrix.
+    void update_world_matrices();
+    // Recomputes the world matrices of dirty subtrees only.
+    void update_dirty_world_matrices();
+
+    u32 size() const { return m_parents.size(); }
+
+    std::vector<glm::vec3> m_translations;
+    std::vector<glm::quat> m_rotations;
+    std::vector<glm::vec3> m_scales;
+    std::vector<u32> m_parents;
+    std::vector<u32> m_first_child;
+    std::vector<u32> m_child_count;
+    std::vector<glm::mat4> m_world_matrices;
+
+   private:
+    void update_world_matrix(u32 slot);
+
+    std::vector<u8> m_dirty;
+    std::vector<u32> m_dirty_slots;
+    std::vector<u32> m_stack;
+};
+
+// Same as T * R * S but without the intermediate matrix products.
+glm::mat4 compose_transform(const glm::vec3& translation, const glm::quat& rotation,
+                            const glm::vec3& scale);
+
+// out = a * b, out must not alias a or b.
+void multiply_transforms(const glm::mat4& a, const glm::mat4& b, glm::mat4& out);
+
+};  // namespace engine
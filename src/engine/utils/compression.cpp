@@ -0,0 +1,256 @@
+#include "compression.h"
+
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace engine {
+
+// The asset file is little endian as well.
+static_assert(std::endian::native == std::endian::little);
+
+static constexpr u32 min_match = 4;
+// The last match has to start at least this many bytes before the end of the block and the last
+// bytes of a block are always literals, so decompressors can copy in whole words.
+static constexpr u64 match_start_margin = 12;
+static constexpr u64 last_literals = 5;
+static constexpr u64 max_offset = 65535;
+static constexpr u32 hash_log = 14;
+// The search step grows by one every 2^skip_strength positions without a match, incompressible
+// data is skipped quickly.
+static constexpr u32 skip_strength = 6;
+
+static u32 read_u32(const u8* ptr) {
+    u32 value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static u64 read_u64(const u8* ptr) {
+    u64 value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static u32 hash_sequence(u32 sequence) { return (sequence * 2654435761u) >> (32 - hash_log); }
+
+// Lengths that do not fit in the four bits of the token continue in bytes of 255 and a last byte
+// below 255.
+static u8* write_length(u8* out, u64 length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (u8)length;
+    return out;
+}
+
+static u8* write_literals(u8* out, u8* token, const u8* literals, u64 num_literals) {
+    *token = (u8)(std::min<u64>(num_literals, 15) << 4);
+    if (num_literals >= 15) out = write_length(out, num_literals - 15);
+    if (num_literals > 0) std::memcpy(out, literals, num_literals);
+    return out + num_literals;
+}
+
+static u8* write_sequence(u8* out, const u8* literals, u64 num_literals, u64 offset,
+                          u64 match_length) {
+    u8* token = out++;
+    out = write_literals(out, token, literals, num_literals);
+    *out++ = (u8)offset;
+    *out++ = (u8)(offset >> 8);
+
+    u64 length = match_length - min_match;
+    *token |= (u8)std::min<u64>(length, 15);
+    if (length >= 15) out = write_length(out, length - 15);
+    return out;
+}
+
+u64 lz4_compress_bound(u64 size) { return size + size / 255 + 16; }
+
+u64 lz4_compress(std::span<const u8> src, std::span<u8> dst) {
+    assert(dst.size() >= lz4_compress_bound(src.size()));
+    const u8* in = src.data();
+    u64 size = src.size();
+    u8* out = dst.data();
+    u64 anchor = 0;
+
+    if (size > match_start_margin) {
+        std::vector<u32> table(1u << hash_log, 0);
+        u64 match_limit = size - match_start_margin;
+        u64 match_end_limit = size - last_literals;
+        u64 pos = 1;
+        table[hash_sequence(read_u32(in))] = 0;
+
+        while (true) {
+            u64 candidate = 0;
+            u32 searches = 1u << skip_strength;
+            bool found = false;
+            while (pos < match_limit) {
+                u32 sequence = read_u32(in + pos);
+                u32 hash = hash_sequence(sequence);
+                candidate = table[hash];
+                table[hash] = (u32)pos;
+                if (candidate < pos && pos - candidate <= max_offset &&
+                    read_u32(in + candidate) == sequence) {
+                    found = true;
+                    break;
+                }
+                pos += searches++ >> skip_strength;
+            }
+            if (!found) break;
+
+            // The match may start before the sequence that was hashed.
+            while (pos > anchor && candidate > 0 && in[pos - 1] == in[candidate - 1]) {
+                pos--;
+                candidate--;
+            }
+
+            u64 length = min_match;
+            while (pos + length + 8 <= match_end_limit) {
+                u64 difference = read_u64(in + pos + length) ^ read_u64(in + candidate + length);
+                if (difference) {
+                    length += std::countr_zero(difference) / 8;
+                    break;
+                }
+                length += 8;
+            }
+            if (pos + length + 8 > match_end_limit) {
+                while (pos + length < match_end_limit &&
+                       in[pos + length] == in[candidate + length]) {
+                    length++;
+                }
+            }
+
+            out = write_sequence(out, in + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+            if (pos >= match_limit) break;
+            table[hash_sequence(read_u32(in + pos - 2))] = (u32)(pos - 2);
+        }
+    }
+
+    u8* token = out++;
+    out = write_literals(out, token, in + anchor, size - anchor);
+    return (u64)(out - dst.data());
+}
+
+bool lz4_decompress(std::span<const u8> src, std::span<u8> dst) {
+    const u8* in = src.data();
+    const u8* in_end = in + src.size();
+    u8* out = dst.data();
+    u8* out_end = out + dst.size();
+
+    auto read_length = [&](u64& length) {
+        u8 byte;
+        do {
+            if (in == in_end) return false;
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (true) {
+        if (in == in_end) return false;
+        u8 token = *in++;
+
+        u64 num_literals = token >> 4;
+        if (num_literals == 15 && !read_length(num_literals)) return false;
+        if (num_literals > (u64)(in_end - in) || num_literals > (u64)(out_end - out)) {
+            return false;
+        }
+        // Short runs are copied as one fixed size block when both sides have room for it.
+        if (num_literals <= 16 && in_end - in >= 16 && out_end - out >= 16) {
+            std::memcpy(out, in, 16);
+        } else if (num_literals > 0) {
+            std::memcpy(out, in, num_literals);
+        }
+        in += num_literals;
+        out += num_literals;
+
+        // The last sequence has no match.
+        if (in == in_end) break;
+
+        if (in_end - in < 2) return false;
+        u64 offset = in[0] | ((u64)in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > (u64)(out - dst.data())) return false;
+
+        u64 length = token & 15;
+        if (length == 15 && !read_length(length)) return false;
+        length += min_match;
+        if (length > (u64)(out_end - out)) return false;
+
+        const u8* match = out - offset;
+        if (offset >= 8 && (u64)(out_end - out) >= length + 8) {
+            // Every word only reads bytes written before it, even when the match overlaps.
+            for (u64 i = 0; i < length; i += 8) {
+                std::memcpy(out + i, match + i, 8);
+            }
+        } else if (offset == 1) {
+            std::memset(out, *match, length);
+        } else {
+            // Overlapping, the match repeats the last offset bytes.
+            for (u64 i = 0; i < length; ++i) {
+                out[i] = match[i];
+            }
+        }
+        out += length;
+    }
+    return out == out_end;
+}
+
+static constexpr u32 xxhash_prime_1 = 2654435761u;
+static constexpr u32 xxhash_prime_2 = 2246822519u;
+static constexpr u32 xxhash_prime_3 = 3266489917u;
+static constexpr u32 xxhash_prime_4 = 668265263u;
+static constexpr u32 xxhash_prime_5 = 374761393u;
+
+static u32 xxhash_round(u32 accumulator, u32 lane) {
+    accumulator += lane * xxhash_prime_2;
+    return std::rotl(accumulator, 13) * xxhash_prime_1;
+}
+
+u32 xxhash32(std::span<const u8> data, u32 seed) {
+    const u8* ptr = data.data();
+    const u8* end = ptr + data.size();
+    u32 hash;
+
+    if (data.size() >= 16) {
+        u32 accumulators[4] = {
+            seed + xxhash_prime_1 + xxhash_prime_2,
+            seed + xxhash_prime_2,
+            seed,
+            seed - xxhash_prime_1,
+        };
+        for (; end - ptr >= 16; ptr += 16) {
+            for (u32 i = 0; i < 4; ++i) {
+                accumulators[i] = xxhash_round(accumulators[i], read_u32(ptr + i * 4));
+            }
+        }
+        hash = std::rotl(accumulators[0], 1) + std::rotl(accumulators[1], 7) +
+               std::rotl(accumulators[2], 12) + std::rotl(accumulators[3], 18);
+    } else {
+        hash = seed + xxhash_prime_5;
+    }
+
+    hash += (u32)data.size();
+    for (; end - ptr >= 4; ptr += 4) {
+        hash += read_u32(ptr) * xxhash_prime_3;
+        hash = std::rotl(hash, 17) * xxhash_prime_4;
+    }
+    for (; ptr < end; ++ptr) {
+        hash += *ptr * xxhash_prime_5;
+        hash = std::rotl(hash, 11) * xxhash_prime_1;
+    }
+
+    hash ^= hash >> 15;
+    hash *= xxhash_prime_2;
+    hash ^= hash >> 13;
+    hash *= xxhash_prime_3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+}  // namespace engine
@@ -0,0 +1,29 @@
+#ifndef _COMPRESSION_H
+#define _COMPRESSION_H
+
+#include <span>
+
+#include "../core.h"
+
+namespace engine {
+
+// LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), so data
+// compressed here can be inspected with the reference tools. The compressor is a greedy single
+// pass one like the fast mode of the reference implementation, the decompressor validates its
+// input and never reads or writes out of bounds.
+
+// Largest possible compressed size of size bytes, incompressible data grows slightly.
+u64 lz4_compress_bound(u64 size);
+// Compresses src as one block into dst, which must hold lz4_compress_bound(src.size()) bytes.
+// Returns the compressed size.
+u64 lz4_compress(std::span<const u8> src, std::span<u8> dst);
+// Decompresses a block that decompresses to exactly dst.size() bytes. Returns false if the block
+// is malformed or has a different size.
+bool lz4_decompress(std::span<const u8> src, std::span<u8> dst);
+
+// XXH32 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md).
+u32 xxhash32(std::span<const u8> data, u32 seed = 0);
+
+}  // namespace engine
+
+#endif
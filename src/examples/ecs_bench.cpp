@@ -0,0 +1,365 @@
+// Compares the sparse set and archetype storage backends on a SMove style system
+// (CPosition + CVelocity) at different entity counts, and measures entity churn, batch
+// signature matching and the parallel system scheduler.
+#include "engine/ecs/archetype.hpp"
+#include "engine/ecs/component.hpp"
+#include "engine/ecs/ecs.hpp"
+#include "engine/ecs/entity.hpp"
+#include "engine/ecs/query.hpp"
+#include "engine/ecs/system.hpp"
+#include <chrono>
+#include <cmath>
+#include <print>
+#include <vector>
+
+class CPosition : public Component<CPosition> {
+public:
+    float x, y;
+};
+
+class CVelocity : public Component<CVelocity> {
+public:
+    float x, y;
+};
+
+class CSize : public Component<CSize> {
+public:
+    float width, height;
+};
+
+class CHealth : public Component<CHealth> {
+public:
+    float value, regeneration;
+};
+
+class CAnimation : public Component<CAnimation> {
+public:
+    float time, speed;
+};
+
+// Three systems touching disjoint components, the scheduler can run all of them at once.
+class SBenchMove : public System<SBenchMove, Write<CPosition>, Read<CVelocity>> {
+    public:
+        SBenchMove() {
+            queries[0] = Query(CPosition::get_id(), CVelocity::get_id());
+            query_count = 1;
+        }
+
+        void update(ECS &ecs) {
+            ecs.for_each<CPosition, CVelocity>(queries[0], [](CPosition &pos, CVelocity &vel) {
+                pos.x += vel.x;
+                pos.y += std::sin(vel.y);
+            });
+        }
+};
+
+class SBenchHealth : public System<SBenchHealth, Write<CHealth>> {
+    public:
+        SBenchHealth() {
+            queries[0] = Query(CHealth::get_id());
+            query_count = 1;
+        }
+
+        void update(ECS &ecs) {
+            ecs.for_each<CHealth>(queries[0], [](CHealth &health) {
+                health.value = std::fmin(health.value + std::sqrt(health.regeneration), 100.0f);
+            });
+        }
+};
+
+class SBenchAnimate : public System<SBenchAnimate, Write<CAnimation>> {
+    public:
+        SBenchAnimate() {
+            queries[0] = Query(CAnimation::get_id());
+            query_count = 1;
+        }
+
+        void update(ECS &ecs) {
+            ecs.for_each<CAnimation>(queries[0], [](CAnimation &animation) {
+                animation.time = std::fmod(animation.time + animation.speed, 1.0f);
+            });
+        }
+};
+
+const u32 ITERATIONS = 20;
+
+using Clock = std::chrono::steady_clock;
+
+static f64 elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<f64, std::milli>(Clock::now() - start).count();
+}
+
+static void bench_entity_churn(u32 entity_count) {
+    const u32 rounds = 4;
+    EntityManager entities;
+    std::vector<Entity> handles(entity_count);
+
+    auto start = Clock::now();
+    for (u32 round = 0; round < rounds; round++) {
+        for (u32 i = 0; i < entity_count; i++) {
+            handles[i] = entities.create_entity();
+        }
+        for (Entity e : handles) {
+            entities.destroy_entity(e);
+        }
+    }
+    f64 total_ms = elapsed_ms(start);
+
+    std::println("churn      {:>8} entities: {:8.2f} ms, {:.1f} M create+destroy per second",
+                 entity_count, total_ms / rounds, rounds * entity_count / (total_ms * 1e3));
+}
+
+static void bench_signature_matching(u32 signature_count) {
+    std::vector<Signature> signatures(signature_count);
+    for (u32 i = 0; i < signature_count; i++) {
+        for (u32 bit = 0; bit < 8; bit++) {
+            if ((i >> bit) & 1) signatures[i].set(bit);
+        }
+    }
+    Signature mask = set_signature(set_signature(Signature(), 1), 3);
+    std::vector<u32> matches(signature_count);
+
+    u32 match_count = 0;
+    auto start = Clock::now();
+    for (u32 i = 0; i < ITERATIONS; i++) {
+        match_count = match_signatures(signatures.data(), signature_count, mask, matches.data());
+    }
+    f64 batch_ms = elapsed_ms(start) / ITERATIONS;
+
+    std::println("match      {:>8} signatures: {:8.3f} ms, {} matches, {} bytes per signature",
+                 signature_count, batch_ms, match_count, sizeof(Signature));
+}
+
+static void bench_sparse_set(u32 entity_count) {
+    EntityManager entities;
+    ComponentManager components;
+    components.register_component<CPosition>();
+    components.register_component<CVelocity>();
+    components.register_component<CSize>();
+
+    // Stand-in for the query entity array, the sparse set path gathers through entity ids.
+    std::vector<Entity> query_entities;
+    auto start = Clock::now();
+    for (u32 i = 0; i < entity_count; i++) {
+        Entity e = entities.create_entity();
+        components.add_component(e, CPosition{.x = (f32)i, .y = 0}, 1);
+        components.add_component(e, CVelocity{.x = 1, .y = 0.5f}, 1);
+        // Every other entity gets an extra component so that there are two archetypes.
+        if (i % 2 == 0) components.add_component(e, CSize{.width = 1, .height = 1}, 1);
+        query_entities.push_back(e);
+    }
+    f64 spawn_ms = elapsed_ms(start);
+
+    start = Clock::now();
+    for (u32 i = 0; i < ITERATIONS; i++) {
+        for (Entity e : query_entities) {
+            CPosition &pos = components.get_component<CPosition>(e);
+            CVelocity &vel = components.get_component<CVelocity>(e);
+            pos.x += vel.x;
+            pos.y += vel.y;
+        }
+    }
+    f64 update_ms = elapsed_ms(start) / ITERATIONS;
+
+    std::println("sparse set {:>8} entities: spawn {:8.2f} ms, update {:8.3f} ms ({:.2f} ns/entity)",
+                 entity_count, spawn_ms, update_ms, update_ms * 1e6 / entity_count);
+}
+
+static void bench_archetype(u32 entity_count) {
+    EntityManager entities;
+    ArchetypeManager archetypes;
+    archetypes.register_component<CPosition>();
+    archetypes.register_component<CVelocity>();
+    archetypes.register_component<CSize>();
+
+    Signature moving = set_signature(set_signature(Signature(), CPosition::get_id()), CVelocity::get_id());
+    Signature sized = set_signature(moving, CSize::get_id());
+
+    auto start = Clock::now();
+    for (u32 i = 0; i < entity_count; i++) {
+        Entity e = entities.create_entity();
+        archetypes.create_entity(e);
+        archetypes.set_signature(e, i % 2 == 0 ? sized : moving, 1);
+        archetypes.get_component<CPosition>(e) = CPosition{.x = (f32)i, .y = 0};
+        archetypes.get_component<CVelocity>(e) = CVelocity{.x = 1, .y = 0.5f};
+        if (i % 2 == 0) archetypes.get_component<CSize>(e) = CSize{.width = 1, .height = 1};
+    }
+    f64 spawn_ms = elapsed_ms(start);
+
+    Query query(CPosition::get_id(), CVelocity::get_id());
+    start = Clock::now();
+    for (u32 i = 0; i < ITERATIONS; i++) {
+        archetypes.for_each<CPosition, const CVelocity>(query, 1, [](CPosition &pos, const CVelocity &vel) {
+            pos.x += vel.x;
+            pos.y += vel.y;
+        });
+    }
+    f64 update_ms = elapsed_ms(start) / ITERATIONS;
+
+    std::println("archetype  {:>8} entities: spawn {:8.2f} ms, update {:8.3f} ms ({:.2f} ns/entity)",
+                 entity_count, spawn_ms, update_ms, update_ms * 1e6 / entity_count);
+}
+
+static void bench_scheduler(u32 entity_count, u32 thread_count) {
+    ECS ecs = ECS(StorageMode::archetype, thread_count);
+    ecs.register_component<CPosition>();
+    ecs.register_component<CVelocity>();
+    ecs.register_component<CHealth>();
+    ecs.register_component<CAnimation>();
+    ecs.register_system<SBenchMove>();
+    ecs.register_system<SBenchHealth>();
+    ecs.register_system<SBenchAnimate>();
+
+    for (u32 i = 0; i < entity_count; i++) {
+        Entity e = ecs.create_entity();
+        ecs.add_components(e,
+                           CPosition{.x = (f32)i, .y = 0},
+                           CVelocity{.x = 1, .y = 0.5f},
+                           CHealth{.value = 0, .regeneration = 0.1f},
+                           CAnimation{.time = 0, .speed = 0.01f});
+    }
+
+    auto start = Clock::now();
+    for (u32 i = 0; i < ITERATIONS; i++) {
+        ecs.update();
+    }
+    f64 update_ms = elapsed_ms(start) / ITERATIONS;
+
+    std::println("scheduler  {:>8} entities: {:>2} threads, update {:8.3f} ms",
+                 entity_count, ecs.get_job_pool()->get_thread_count(), update_ms);
+}
+
+// Steering towards a target over a single query, split into jobs with par_for_each.
+static void bench_par_for_each(StorageMode storage_mode, u32 entity_count, u32 thread_count) {
+    ECS ecs = ECS(storage_mode, thread_count);
+    ecs.register_component<CPosition>();
+    ecs.register_component<CVelocity>();
+    SBenchMove *system = ecs.register_system<SBenchMove>();
+    Query &query = system->queries[0];
+    for (u32 i = 0; i < entity_count; i++) {
+        Entity e = ecs.create_entity();
+        ecs.add_components(e, CPosition{.x = (f32)i, .y = 0}, CVelocity{.x = 0, .y = 0});
+    }
+
+    auto start = Clock::now();
+    for (u32 i = 0; i < ITERATIONS; i++) {
+        query.par_for_each<CPosition, CVelocity>([](CPosition &pos, CVelocity &vel) {
+            f32 dx = 100.0f - pos.x;
+            f32 dy = 50.0f - pos.y;
+            f32 dist = std::sqrt(dx * dx + dy * dy);
+            if (dist > 0) {
+                vel.x = dx / dist;
+                vel.y = dy / dist;
+            }
+            pos.x += vel.x;
+            pos.y += vel.y;
+        });
+    }
+    f64 update_ms = elapsed_ms(start) / ITERATIONS;
+
+    std::println("par_for_each {} {:>8} entities: {:>2} threads, update {:8.3f} ms",
+                 storage_mode == StorageMode::archetype ? "archetype " : "sparse set", entity_count,
+                 ecs.get_job_pool()->get_thread_count(), update_ms);
+}
+
+// Spawns entities with three components, either one add_component at a time or recorded in a
+// command buffer where the flush applies a single signature change per entity. The commands are
+// flushed every COMMAND_BATCH entities like they would be once per frame.
+const u32 COMMAND_BATCH = 1000;
+
+static void bench_commands(StorageMode storage_mode, u32 entity_count) {
+    const char *name = storage_mode == StorageMode::archetype ? "archetype " : "sparse set";
+    for (bool deferred : {false, true}) {
+        ECS ecs = ECS(storage_mode, 1);
+        ecs.register_component<CPosition>();
+        ecs.register_component<CVelocity>();
+        ecs.register_component<CHealth>();
+        ecs.register_system<SBenchMove>();
+
+        auto start = Clock::now();
+        if (deferred) {
+            CommandBuffer *commands = ecs.get_command_buffer();
+            for (u32 i = 0; i < entity_count; i++) {
+                Entity e = commands->create_entity();
+                commands->add_component(e, CPosition{.x = (f32)i, .y = 0});
+                commands->add_component(e, CVelocity{.x = 1, .y = 0});
+                commands->add_component(e, CHealth{.value = 100, .regeneration = 0});
+                if ((i + 1) % COMMAND_BATCH == 0) ecs.flush();
+            }
+            ecs.flush();
+        } else {
+            for (u32 i = 0; i < entity_count; i++) {
+                Entity e = ecs.create_entity();
+                ecs.add_component(e, CPosition{.x = (f32)i, .y = 0});
+                ecs.add_component(e, CVelocity{.x = 1, .y = 0});
+                ecs.add_component(e, CHealth{.value = 100, .regeneration = 0});
+            }
+        }
+        f64 spawn_ms = elapsed_ms(start);
+
+        std::println("commands   {} {:>8} entities: {}, spawn {:8.2f} ms", name, entity_count,
+                     deferred ? "deferred " : "immediate", spawn_ms);
+    }
+}
+
+// Touches 1% of the positions every frame and visits them through a Changed<CPosition> query,
+// compared to visiting every entity.
+static void bench_change_detection(StorageMode storage_mode, u32 entity_count) {
+    ECS ecs = ECS(storage_mode, 1);
+    ecs.register_component<CPosition>();
+    ecs.register_component<CVelocity>();
+    SBenchMove *system = ecs.register_system<SBenchMove>();
+    Query all = system->queries[0];
+    Query changed = Query(CPosition::get_id(), CVelocity::get_id()).with<Changed<CPosition>>();
+    std::vector<Entity> entities;
+    for (u32 i = 0; i < entity_count; i++) {
+        Entity e = ecs.create_entity();
+        ecs.add_components(e, CPosition{.x = (f32)i, .y = 0}, CVelocity{.x = 1, .y = 0});
+        entities.push_back(e);
+    }
+    all.entities = system->queries[0].entities;
+    changed.entities = system->queries[0].entities;
+    all.ecs = changed.ecs = &ecs;
+
+    f64 visited[2] = {};
+    f64 update_ms[2] = {};
+    f64 checksum = 0;
+    for (u32 pass = 0; pass < 2; pass++) {
+        Query &query = pass == 0 ? all : changed;
+        for (u32 i = 0; i < ITERATIONS; i++) {
+            query.last_run_tick = ecs.advance_change_tick();
+            for (u32 j = i; j < entity_count; j += 100) {
+                ecs.get_component<CPosition>(entities[j]).y += 1;
+            }
+
+            auto start = Clock::now();
+            query.for_each<const CPosition, const CVelocity>([&](const CPosition &pos, const CVelocity &vel) {
+                // Stand-in for the per entity work, e.g. rebuilding a matrix for upload.
+                checksum += std::sqrt(pos.x * pos.x + pos.y * pos.y) * vel.x;
+                visited[pass]++;
+            });
+            update_ms[pass] += elapsed_ms(start) / ITERATIONS;
+        }
+    }
+
+    std::println("changed    {} {:>8} entities: all {:8.3f} ms, Changed<CPosition> {:8.3f} ms ({:.0f} visited, checksum {:.0f})",
+                 storage_mode == StorageMode::archetype ? "archetype " : "sparse set", entity_count,
+                 update_ms[0], update_ms[1], visited[1] / ITERATIONS, checksum);
+}
+
+int main() {
+    for (u32 entity_count : {10'000u, 100'000u, 1'000'000u}) {
+        bench_sparse_set(entity_count);
+        bench_archetype(entity_count);
+        bench_entity_churn(entity_count);
+        bench_signature_matching(entity_count);
+        bench_scheduler(entity_count, 1);
+        bench_scheduler(entity_count, 0);
+        for (StorageMode storage_mode : {StorageMode::sparse_set, StorageMode::archetype}) {
+            bench_par_for_each(storage_mode, entity_count, 1);
+            bench_par_for_each(storage_mode, entity_count, 0);
+            bench_commands(storage_mode, entity_count);
+            bench_change_detection(storage_mode, entity_count);
+        }
+    }
+}
@@ -32,27 +32,27 @@ class CName : public Component<CName> {
         char name[32];
 };
 
-class SMove : public System<SMove> {
+class SMove : public System<SMove, Write<CPosition>, Read<CVelocity>> {
     public:
         SMove() {
             queries[0] = Query(CPosition::get_id(), CVelocity::get_id());
             query_count = 1;
         }
 
-        void update(ECS &ecs) {
-            auto entities = get_query(0)->get_entities();
-            Iterator it = { .next = 0 };
-            Entity e;
-            while (entities->next(it, e)) {
-                CPosition& pos = ecs.get_component<CPosition>(e);
-                CVelocity& vel = ecs.get_component<CVelocity>(e);
+        void update(ECS &) {
+            get_query(0)->par_for_each<CPosition, const CVelocity>([](CPosition& pos, const CVelocity& vel) {
                 pos.x += vel.x;
                 pos.y += vel.y;
-            }
+            });
         }
 };
 
-class SWalkTowardsPlayer : public System<SWalkTowardsPlayer> {
+class RSteering : public Resource<RSteering> {
+    public:
+        float enemy_speed;
+};
+
+class SWalkTowardsPlayer : public System<SWalkTowardsPlayer, Read<CPosition, CEnemy, CPlayer>, Write<CVelocity>, Res<RSteering>> {
     public:
         SWalkTowardsPlayer() {
             queries[0] = Query(CVelocity::get_id(), CPosition::get_id(), CEnemy::get_id());
@@ -61,29 +61,23 @@ class SWalkTowardsPlayer : public System<SWalkTowardsPlayer> {
         }
 
         void update(ECS &ecs) {
-            auto enemy_entities = get_query(0)->get_entities();
             auto player_entities = get_query(1)->get_entities();
             auto player = player_entities->first();
-            auto player_pos = ecs.get_component<CPosition>(*player);
-            Iterator it = { .next = 0 };
-            Entity e;
-            while (enemy_entities->next(it, e)) {
-                CPosition& enemy_pos = ecs.get_component<CPosition>(e);
-                CVelocity& enemy_vel = ecs.get_component<CVelocity>(e);
-                CEnemy& enemy = ecs.get_component<CEnemy>(e);
-
+            auto player_pos = ecs.read_component<CPosition>(*player);
+            float speed = ecs.resource<RSteering>()->enemy_speed;
+            get_query(0)->par_for_each<const CPosition, CVelocity>([player_pos, speed](const CPosition& enemy_pos, CVelocity& enemy_vel) {
                 float dx = player_pos.x - enemy_pos.x;
                 float dy = player_pos.y - enemy_pos.y;
                 float dist = sqrt(dx * dx + dy * dy);
                 if (dist > 0) {
-                    enemy_vel.x = dx / dist;
-                    enemy_vel.y = dy / dist;
+                    enemy_vel.x = dx / dist * speed;
+                    enemy_vel.y = dy / dist * speed;
                 }
-            }
+            });
         }
 };
 
-class SCollide : public System<SCollide> {
+class SCollide : public System<SCollide, Read<CPosition, CSize>> {
     public:
         SCollide() {
             queries[0] = Query(CPosition::get_id(), CSize::get_id());
@@ -98,13 +92,13 @@ class SCollide : public System<SCollide> {
             Iterator it_b = { .next = 0 };
             Entity e_a, e_b;
             while (entities_a->next(it_a, e_a)) {
-                CPosition& pos_a = ecs.get_component<CPosition>(e_a);
-                CSize& size_a = ecs.get_component<CSize>(e_a);
+                const CPosition& pos_a = ecs.read_component<CPosition>(e_a);
+                const CSize& size_a = ecs.read_component<CSize>(e_a);
                 while (entities_b->next(it_b, e_b)) {
                     // Skip self-collision
                     if (e_a == e_b) continue;
-                    CPosition& pos_b = ecs.get_component<CPosition>(e_b);
-                    CSize& size_b = ecs.get_component<CSize>(e_b);
+                    const CPosition& pos_b = ecs.read_component<CPosition>(e_b);
+                    const CSize& size_b = ecs.read_component<CSize>(e_b);
 
                     if (pos_a.x < pos_b.x + size_b.width &&
                         pos_a.x + size_a.width > pos_b.x &&
@@ -118,22 +112,18 @@ class SCollide : public System<SCollide> {
         }
 };
 
-class SRender : public System<SRender> {
+class SRender : public System<SRender, Read<CPosition, CName>> {
     public:
         SRender() {
-            queries[0] = Query(CPosition::get_id(), CName::get_id());
+            // Only entities that moved since the last frame are redrawn.
+            queries[0] = Query(CPosition::get_id(), CName::get_id()).with<Changed<CPosition>>();
             query_count = 1;
         }
 
-        void update(ECS &ecs) {
-            auto entities = get_query(0)->get_entities();
-            Iterator it = { .next = 0 };
-            Entity e;
-            while (entities->next(it, e)) {
-                CPosition& pos = ecs.get_component<CPosition>(e);
-                CName& name = ecs.get_component<CName>(e);
+        void update(ECS &) {
+            get_query(0)->for_each<const CPosition, const CName>([](const CPosition& pos, const CName& name) {
                 printf("Rendering entity %s at position (%f, %f)\n", name.name, pos.x, pos.y);
-            }
+            });
         }
 };
 
@@ -145,17 +135,20 @@ int main() {
     ecs.register_component<CEnemy>();
     ecs.register_component<CSize>();
     ecs.register_component<CName>();
-    auto move_system = ecs.register_system<SMove>();
-    auto walk_system = ecs.register_system<SWalkTowardsPlayer>();
-    auto collide_system = ecs.register_system<SCollide>();
-    auto render_system = ecs.register_system<SRender>();
+    ecs.insert_resource<RSteering>(RSteering{.enemy_speed = 1.0f});
+
+    ecs.register_system<SMove>();
+    ecs.register_system<SWalkTowardsPlayer>();
+    ecs.register_system<SCollide>();
+    ecs.register_system<SRender>();
 
     Entity player = ecs.create_entity();
-    ecs.add_component<CPlayer>(player, CPlayer());
-    ecs.add_component<CPosition>(player, CPosition{.x = 1, .y = 0});
-    ecs.add_component<CVelocity>(player, CVelocity{.x = 0.6, .y = 0.1});
-    ecs.add_component<CSize>(player, CSize{.width = .2, .height = .2});
-    ecs.add_component<CName>(player, CName{.name = "Player"});
+    ecs.add_components(player,
+                       CPlayer(),
+                       CPosition{.x = 1, .y = 0},
+                       CVelocity{.x = 0.6, .y = 0.1},
+                       CSize{.width = .2, .height = .2},
+                       CName{.name = "Player"});
     Entity enemy = ecs.create_entity();
     ecs.add_component<CEnemy>(enemy, CEnemy());
     ecs.add_component<CPosition>(enemy, CPosition{.x = 0, .y = 0});
@@ -164,10 +157,9 @@ int main() {
     ecs.add_component<CName>(enemy, CName{.name = "Enemy"});
 
     for (int i = 0; i < 15; i++) {
-        move_system->update(ecs);
-        walk_system->update(ecs);
-        collide_system->update(ecs);
-        render_system->update(ecs);
+        // SMove runs first since it writes the positions, the other three only read them and
+        // run in parallel.
+        ecs.update();
     }
 }
 
@@ -0,0 +1,331 @@
+// Headless benchmark of meshlet culling. Walks a camera along sample paths through the scene of
+// an asset file (Sponza when built from it) and reports how many triangles are culled with the
+// primitive bounds alone, and how many more the meshlet bounding spheres and normal cones cull.
+// Every meshlet culled by its cone is checked to only contain triangles facing away from the
+// camera.
+//
+// Usage: meshlet_bench [asset file], defaults to scene_data.bin. Without an asset file a grid of
+// spheres is built instead.
+#include "../../tools/asset_processor/src/MeshOptimizer.h"
+#include "engine/AssetLoader.h"
+#include "engine/core.h"
+#include "engine/graphics/Culling.h"
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <numbers>
+#include <print>
+#include <vector>
+
+using namespace engine;
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Instance {
+    u32 primitive_index;
+    glm::mat4 world;
+};
+
+// The geometry of the scene with the positions decoded, so the cone culling can be checked.
+struct BenchScene {
+    std::vector<Primitive> primitives;
+    std::vector<Meshlet> meshlets;
+    std::vector<Instance> instances;
+    // Indices of every primitive relative to its first vertex, starting at index_starts[i].
+    std::vector<u32> indices;
+    std::vector<u32> index_starts;
+    std::vector<glm::vec3> positions;
+    glm::vec3 aabb_min = glm::vec3(FLT_MAX);
+    glm::vec3 aabb_max = glm::vec3(-FLT_MAX);
+
+    void add_instance(u32 primitive_index, const glm::mat4& world) {
+        instances.push_back({primitive_index, world});
+        const auto& bounds = primitives[primitive_index].bounds;
+        for (u32 corner = 0; corner < 8; ++corner) {
+            glm::vec3 local(corner & 1 ? bounds.aabb_max.x : bounds.aabb_min.x,
+                            corner & 2 ? bounds.aabb_max.y : bounds.aabb_min.y,
+                            corner & 4 ? bounds.aabb_max.z : bounds.aabb_min.z);
+            glm::vec3 point = glm::vec3(world * glm::vec4(local, 1.0f));
+            aabb_min = glm::min(aabb_min, point);
+            aabb_max = glm::max(aabb_max, point);
+        }
+    }
+};
+
+static void add_prefab_node(BenchScene& scene, const loader::AssetFileData& data, u32 node_index,
+                            const glm::mat4& parent) {
+    const auto& node = data.prefab_nodes[node_index];
+    glm::mat4 world = parent * glm::translate(glm::mat4(1.0f), node.translation) *
+                      glm::mat4_cast(node.rotation) * glm::scale(glm::mat4(1.0f), node.scale);
+    if (node.mesh_index != UINT32_MAX) {
+        const auto& mesh = data.meshes[node.mesh_index];
+        for (u32 i = 0; i < mesh.num_primitives; ++i) {
+            scene.add_instance(mesh.primitive_index + i, world);
+        }
+    }
+    for (u32 i = 0; i < node.num_children; ++i) {
+        add_prefab_node(scene, data, node.child_index + i, world);
+    }
+}
+
+static void load_scene(BenchScene& scene, const char* path) {
+    loader::AssetFileData data = loader::load_asset_file(path);
+    scene.primitives.assign(data.primitives.begin(), data.primitives.end());
+    scene.meshlets.assign(data.meshlets.begin(), data.meshlets.end());
+
+    scene.positions.resize(data.vertices.size());
+    for (const auto& prim : scene.primitives) {
+        glm::vec3 extent = prim.bounds.aabb_max - prim.bounds.aabb_min;
+        for (u32 v = prim.base_vertex; v < prim.base_vertex + prim.num_vertices; ++v) {
+            const auto& packed = data.vertices[v];
+            glm::vec3 unorm(packed.pos[0], packed.pos[1], packed.pos[2]);
+            scene.positions[v] = prim.bounds.aabb_min + unorm * (1.0f / 65535.0f) * extent;
+        }
+
+        scene.index_starts.push_back(scene.indices.size());
+        const u8* indices = data.indices.data() + prim.indices_start;
+        for (u32 i = 0; i < prim.num_indices(); ++i) {
+            bool is_u16 = prim.index_type == 5123;
+            scene.indices.push_back(is_u16 ? ((const u16*)indices)[i] : ((const u32*)indices)[i]);
+        }
+    }
+
+    for (u32 root : data.root_prefab_nodes) {
+        add_prefab_node(scene, data, root, glm::mat4(1.0f));
+    }
+    loader::unload_asset_file(data);
+}
+
+// A grid of spheres, optimized and split into meshlets like the asset processor does.
+static void build_sphere_scene(BenchScene& scene) {
+    const u32 rings = 128;
+    const u32 segments = 256;
+    std::vector<Vertex> vertices;
+    for (u32 ring = 0; ring <= rings; ++ring) {
+        f32 theta = std::numbers::pi_v<f32> * ring / rings;
+        for (u32 segment = 0; segment <= segments; ++segment) {
+            f32 phi = 2.0f * std::numbers::pi_v<f32> * segment / segments;
+            glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta),
+                             -std::sin(theta) * std::sin(phi));
+            vertices.push_back({.tangent = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),
+                                .pos = normal,
+                                .normal = normal,
+                                .uv = glm::vec2((f32)segment / segments, (f32)ring / rings)});
+        }
+    }
+    std::vector<u32> indices;
+    for (u32 ring = 0; ring < rings; ++ring) {
+        for (u32 segment = 0; segment < segments; ++segment) {
+            u32 a = ring * (segments + 1) + segment;
+            u32 b = a + segments + 1;
+            // Counter clockwise seen from outside.
+            indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+        }
+    }
+    optimize_mesh(vertices, indices);
+
+    glm::vec3 aabb_min(FLT_MAX), aabb_max(-FLT_MAX);
+    for (const auto& vertex : vertices) {
+        scene.positions.push_back(vertex.pos);
+        aabb_min = glm::min(aabb_min, vertex.pos);
+        aabb_max = glm::max(aabb_max, vertex.pos);
+    }
+    scene.meshlets = build_meshlets(indices, vertices);
+    scene.index_starts.push_back(0);
+    scene.indices = indices;
+    scene.primitives.push_back({
+        .base_vertex = 0,
+        .num_vertices = (u32)vertices.size(),
+        .indices_start = 0,
+        .indices_end = (u32)indices.size() * 4,
+        .index_type = 5125,
+        .material_index = 0,
+        .bounds = {.aabb_min = aabb_min, .aabb_max = aabb_max},
+        .meshlet_index = 0,
+        .num_meshlets = (u32)scene.meshlets.size(),
+    });
+
+    for (i32 x = -8; x <= 8; ++x) {
+        for (i32 z = -8; z <= 8; ++z) {
+            glm::mat4 world = glm::translate(glm::mat4(1.0f), glm::vec3(x * 4.0f, 1.0f, z * 4.0f));
+            scene.add_instance(0, world);
+        }
+    }
+}
+
+struct CullStats {
+    u64 triangles = 0;
+    u64 primitive_culled = 0;
+    u64 frustum_culled = 0;
+    u64 cone_culled = 0;
+    u64 meshlets_tested = 0;
+    u64 meshlets_visible = 0;
+    // Front facing triangles of meshlets culled by their cone, should be 0.
+    u64 wrongly_culled = 0;
+    double cull_ms = 0;
+
+    void add(const CullStats& other) {
+        triangles += other.triangles;
+        primitive_culled += other.primitive_culled;
+        frustum_culled += other.frustum_culled;
+        cone_culled += other.cone_culled;
+        meshlets_tested += other.meshlets_tested;
+        meshlets_visible += other.meshlets_visible;
+        wrongly_culled += other.wrongly_culled;
+        cull_ms += other.cull_ms;
+    }
+};
+
+static u64 count_front_facing(const BenchScene& scene, const Instance& instance,
+                              const Meshlet& meshlet, const glm::vec3& camera_pos) {
+    const auto& prim = scene.primitives[instance.primitive_index];
+    const u32* indices =
+        scene.indices.data() + scene.index_starts[instance.primitive_index] + meshlet.index_offset;
+    glm::vec3 local_camera = glm::vec3(glm::inverse(instance.world) * glm::vec4(camera_pos, 1.0f));
+
+    u64 front_facing = 0;
+    for (u32 t = 0; t < meshlet.num_triangles; ++t) {
+        glm::vec3 a = scene.positions[prim.base_vertex + indices[t * 3 + 0]];
+        glm::vec3 b = scene.positions[prim.base_vertex + indices[t * 3 + 1]];
+        glm::vec3 c = scene.positions[prim.base_vertex + indices[t * 3 + 2]];
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        // Small tolerance for triangles seen edge on and the quantization of the positions.
+        front_facing += glm::dot(normal, local_camera - a) > 1e-3f * glm::length(normal);
+    }
+    return front_facing;
+}
+
+// Culls like Renderer::draw_hierarchy followed by Renderer::append_meshlet_commands.
+static CullStats cull_frame(const BenchScene& scene, const glm::vec3& camera_pos,
+                            const glm::vec3& direction, bool verify) {
+    glm::mat4 view = glm::lookAt(camera_pos, camera_pos + direction, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    Frustum frustum = Frustum::from_view_projection(projection * view);
+
+    CullStats stats;
+    auto start = Clock::now();
+    FrustumCuller culler;
+    std::vector<u8> visible;
+    for (const auto& instance : scene.instances) {
+        const auto& bounds = scene.primitives[instance.primitive_index].bounds;
+        culler.push(bounds.aabb_min, bounds.aabb_max, instance.world);
+    }
+    culler.cull(frustum, visible);
+
+    MeshletCuller meshlet_culler;
+    std::vector<std::pair<u32, u32>> cone_culled;
+    for (u32 i = 0; i < scene.instances.size(); ++i) {
+        const auto& instance = scene.instances[i];
+        const auto& prim = scene.primitives[instance.primitive_index];
+        u64 triangles = prim.num_indices() / 3;
+        stats.triangles += triangles;
+        if (!visible[i]) {
+            stats.primitive_culled += triangles;
+            continue;
+        }
+
+        meshlet_culler.set_instance(frustum, camera_pos, instance.world);
+        for (u32 m = prim.meshlet_index; m < prim.meshlet_index + prim.num_meshlets; ++m) {
+            const auto& meshlet = scene.meshlets[m];
+            stats.meshlets_tested++;
+            if (!meshlet_culler.frustum_visible(meshlet.sphere_center, meshlet.sphere_radius)) {
+                stats.frustum_culled += meshlet.num_triangles;
+            } else if (!meshlet_culler.cone_visible(meshlet.sphere_center, meshlet.sphere_radius,
+                                                    meshlet.cone_axis, meshlet.cone_cutoff)) {
+                stats.cone_culled += meshlet.num_triangles;
+                if (verify) cone_culled.push_back({i, m});
+            } else {
+                stats.meshlets_visible++;
+            }
+        }
+    }
+    stats.cull_ms = elapsed_ms(start);
+
+    for (auto [i, m] : cone_culled) {
+        stats.wrongly_culled +=
+            count_front_facing(scene, scene.instances[i], scene.meshlets[m], camera_pos);
+    }
+    return stats;
+}
+
+static double percent(u64 part, u64 total) {
+    return total ? 100.0 * part / total : 0.0;
+}
+
+// Walks an ellipse inside the scene bounds at the given fraction of the scene height. Walking
+// looks along the path, orbiting looks at the center of the scene.
+static CullStats run_path(const BenchScene& scene, const char* name, f32 height, bool orbit) {
+    const u32 steps = 64;
+    glm::vec3 center = (scene.aabb_min + scene.aabb_max) * 0.5f;
+    glm::vec3 extent = scene.aabb_max - scene.aabb_min;
+    f32 y = scene.aabb_min.y + extent.y * height;
+    f32 radius = orbit ? 0.6f : 0.3f;
+
+    std::vector<std::pair<glm::vec3, glm::vec3>> cameras;
+    for (u32 step = 0; step < steps; ++step) {
+        f32 angle = 2.0f * std::numbers::pi_v<f32> * step / steps;
+        glm::vec3 camera_pos(center.x + std::cos(angle) * extent.x * radius, y,
+                             center.z + std::sin(angle) * extent.z * radius);
+        glm::vec3 direction = orbit ? glm::vec3(center.x, y, center.z) - camera_pos
+                                    : glm::vec3(-std::sin(angle) * extent.x, 0.0f,
+                                                std::cos(angle) * extent.z);
+        if (glm::length(direction) == 0.0f) direction = glm::vec3(0.0f, 0.0f, -1.0f);
+        cameras.push_back({camera_pos, glm::normalize(direction)});
+    }
+
+    CullStats total;
+    for (const auto& [camera_pos, direction] : cameras) {
+        total.add(cull_frame(scene, camera_pos, direction, true));
+    }
+    // Timed again without the verification.
+    total.cull_ms = 0;
+    for (const auto& [camera_pos, direction] : cameras) {
+        total.cull_ms += cull_frame(scene, camera_pos, direction, false).cull_ms;
+    }
+
+    std::println("{:<24} {:>6.1f}% primitive culled, {:>6.1f}% meshlet frustum culled, {:>6.1f}% "
+                 "cone culled, {:>6.1f}% drawn, {:.3f} ms/frame",
+                 name, percent(total.primitive_culled, total.triangles),
+                 percent(total.frustum_culled, total.triangles),
+                 percent(total.cone_culled, total.triangles),
+                 percent(total.triangles - total.primitive_culled - total.frustum_culled -
+                             total.cone_culled,
+                         total.triangles),
+                 total.cull_ms / steps);
+    return total;
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "scene_data.bin";
+
+    BenchScene scene;
+    if (std::filesystem::exists(path)) {
+        load_scene(scene, path);
+    } else {
+        std::println("{} not found, using a grid of spheres", path);
+        build_sphere_scene(scene);
+    }
+
+    u64 triangles = 0;
+    for (const auto& instance : scene.instances) {
+        triangles += scene.primitives[instance.primitive_index].num_indices() / 3;
+    }
+    std::println("{} instances, {} triangles, {} meshlets of {:.1f} triangles on average",
+                 scene.instances.size(), triangles, scene.meshlets.size(),
+                 scene.meshlets.empty() ? 0.0 : (double)scene.indices.size() / 3 / scene.meshlets.size());
+
+    CullStats total;
+    total.add(run_path(scene, "walk, floor", 0.1f, false));
+    total.add(run_path(scene, "walk, middle", 0.5f, false));
+    total.add(run_path(scene, "orbit, floor", 0.1f, true));
+    total.add(run_path(scene, "orbit, above", 0.9f, true));
+
+    std::println("{} of {} meshlets visible, {} front facing triangles culled by cones",
+                 total.meshlets_visible, total.meshlets_tested, total.wrongly_culled);
+    return total.wrongly_culled == 0 ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+// Headless benchmarks of the renderer data structures, nothing here needs an OpenGL context.
+// Measures building and sorting the render queue, checks the resulting draw order and measures
+// frustum culling against a scalar reference, and checks the ring buffer bookkeeping with a
+// backend that does not need a GPU.
+#include "engine/core.h"
+#include "engine/graphics/Culling.h"
+#include "engine/graphics/RenderQueue.h"
+#include "engine/graphics/RingBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <print>
+#include <random>
+#include <vector>
+
+using namespace engine;
+
+const u32 ITERATIONS = 20;
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Fills the queue like a scene with a few materials and many instances of a few meshes.
+static void build_queue(RenderQueue &queue, u32 item_count, u32 material_count, std::mt19937 &rng) {
+    std::uniform_int_distribution<u32> material(0, material_count - 1);
+    std::uniform_real_distribution<f32> depth(0.1f, 1000.0f);
+
+    queue.clear();
+    for (u32 i = 0; i < item_count; i++) {
+        u32 material_index = material(rng);
+        u32 primitive_index = material_index * 4 + i % 4;
+        u32 transform_index = queue.push_transform(glm::mat4(1.0f));
+        u64 key = SortKey::make(0, material_index, primitive_index, 0, depth(rng));
+        queue.push(key, primitive_index, transform_index);
+    }
+}
+
+static void bench_render_queue(u32 item_count, u32 material_count) {
+    RenderQueue queue;
+    std::mt19937 rng(1337);
+
+    double build_total = 0;
+    double sort_total = 0;
+    double std_sort_total = 0;
+    u32 material_changes = 0;
+    bool sorted = true;
+    for (u32 iteration = 0; iteration < ITERATIONS; iteration++) {
+        auto start = Clock::now();
+        build_queue(queue, item_count, material_count, rng);
+        build_total += elapsed_ms(start);
+
+        std::vector<DrawItem> reference = queue.m_items;
+        start = Clock::now();
+        std::stable_sort(reference.begin(), reference.end(),
+                         [](const DrawItem &a, const DrawItem &b) { return a.sort_key < b.sort_key; });
+        std_sort_total += elapsed_ms(start);
+
+        start = Clock::now();
+        queue.sort();
+        sort_total += elapsed_ms(start);
+
+        // The radix sort is stable so it has to match std::stable_sort item for item.
+        material_changes = 0;
+        for (u32 i = 0; i < item_count; i++) {
+            sorted &= queue.m_items[i].sort_key == reference[i].sort_key &&
+                      queue.m_items[i].transform_index == reference[i].transform_index;
+            if (i == 0 || SortKey::material(queue.m_items[i].sort_key) !=
+                              SortKey::material(queue.m_items[i - 1].sort_key)) {
+                material_changes++;
+            }
+        }
+    }
+
+    std::println("queue {:>8} items {:>4} materials: build {:7.3f} ms, radix sort {:7.3f} ms, std::stable_sort {:7.3f} ms, {} material binds, {}",
+                 item_count, material_count, build_total / ITERATIONS, sort_total / ITERATIONS,
+                 std_sort_total / ITERATIONS, material_changes, sorted ? "order ok" : "ORDER MISMATCH");
+}
+
+static glm::mat4 make_view_projection() {
+    // The camera of the game, at the origin looking down -z with a 90 degree field of view.
+    f32 aspect_ratio = 16.0f / 9.0f;
+    f32 near = 0.1f;
+    f32 far = 1000.0f;
+    f32 f = 1.0f / std::tan(0.5f * 3.14159265f * 0.5f);
+
+    glm::mat4 projection(0.0f);
+    projection[0][0] = f / aspect_ratio;
+    projection[1][1] = f;
+    projection[2][2] = -(far + near) / (far - near);
+    projection[2][3] = -1.0f;
+    projection[3][2] = -(2.0f * far * near) / (far - near);
+    return projection;
+}
+
+static bool box_visible_reference(const Frustum &frustum, const FrustumCuller &culler, u32 i) {
+    for (const auto &plane : frustum.planes) {
+        f32 distance = plane.x * culler.m_center_x[i] + plane.y * culler.m_center_y[i] +
+                       plane.z * culler.m_center_z[i] + plane.w +
+                       std::abs(plane.x) * culler.m_extent_x[i] +
+                       std::abs(plane.y) * culler.m_extent_y[i] +
+                       std::abs(plane.z) * culler.m_extent_z[i];
+        if (distance < 0.0f) return false;
+    }
+    return true;
+}
+
+static void bench_culling(u32 box_count) {
+    FrustumCuller culler;
+    Frustum frustum = Frustum::from_view_projection(make_view_projection());
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<f32> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<f32> size(0.1f, 10.0f);
+
+    double push_total = 0;
+    double cull_total = 0;
+    double reference_total = 0;
+    u32 visible_count = 0;
+    bool matches = true;
+    std::vector<u8> visible;
+    for (u32 iteration = 0; iteration < ITERATIONS; iteration++) {
+        // Unit boxes placed and scaled by their world matrix, like primitives of a scene.
+        std::vector<glm::mat4> transforms(box_count, glm::mat4(1.0f));
+        for (auto &transform : transforms) {
+            f32 scale = size(rng);
+            transform[0][0] = scale;
+            transform[1][1] = scale;
+            transform[2][2] = scale;
+            transform[3] = glm::vec4(position(rng), position(rng), position(rng), 1.0f);
+        }
+
+        auto start = Clock::now();
+        culler.clear();
+        for (const auto &transform : transforms) {
+            culler.push(glm::vec3(-0.5f), glm::vec3(0.5f), transform);
+        }
+        push_total += elapsed_ms(start);
+
+        start = Clock::now();
+        visible_count = culler.cull(frustum, visible);
+        cull_total += elapsed_ms(start);
+
+        start = Clock::now();
+        u32 reference_count = 0;
+        for (u32 i = 0; i < box_count; i++) {
+            bool reference = box_visible_reference(frustum, culler, i);
+            reference_count += reference;
+            matches &= reference == (bool)visible[i];
+        }
+        reference_total += elapsed_ms(start);
+        matches &= reference_count == visible_count;
+    }
+
+    std::println("cull  {:>8} boxes: transform {:7.3f} ms, cull {:7.3f} ms, scalar {:7.3f} ms, {} visible, {}",
+                 box_count, push_total / ITERATIONS, cull_total / ITERATIONS,
+                 reference_total / ITERATIONS, visible_count, matches ? "result ok" : "RESULT MISMATCH");
+}
+
+// Fences are frame numbers, a frame is finished by the "GPU" when its fence is waited on. Every
+// allocation handed out is checked against the allocations of unfinished frames.
+struct MockRingBackend {
+    struct Allocation {
+        u32 offset;
+        u32 size;
+        u64 frame;
+    };
+
+    std::vector<u8> memory;
+    std::vector<Allocation> live;
+    u64 frame = 1;
+    u32 waits = 0;
+    bool overlap = false;
+
+    u8 *create(u32 size) {
+        memory.resize(size);
+        return memory.data();
+    }
+    void destroy() { memory.clear(); }
+    void *insert_fence() { return (void *)(uintptr_t)frame++; }
+    void wait_fence(void *fence) {
+        u64 finished = (u64)(uintptr_t)fence;
+        std::erase_if(live, [finished](const Allocation &a) { return a.frame == finished; });
+        waits++;
+    }
+    void delete_fence(void *) {}
+
+    void track(u32 offset, u32 size) {
+        for (const auto &allocation : live) {
+            overlap |= offset < allocation.offset + allocation.size &&
+                       allocation.offset < offset + size;
+        }
+        live.push_back({offset, size, frame});
+    }
+};
+
+static void check_ring_buffer() {
+    RingBuffer<MockRingBackend> ring;
+    ring.init(1 << 20, 256);
+    std::mt19937 rng(1337);
+    std::uniform_int_distribution<u32> allocation_size(1, 64 << 10);
+    std::uniform_int_distribution<u32> allocation_count(1, 8);
+
+    const u32 frame_count = 10'000;
+    u64 bytes = 0;
+    bool failed = false;
+    auto start = Clock::now();
+    for (u32 frame = 0; frame < frame_count; ++frame) {
+        u32 count = allocation_count(rng);
+        for (u32 i = 0; i < count; ++i) {
+            u32 size = allocation_size(rng);
+            u32 offset = ring.allocate(size);
+            if (offset == RingBuffer<MockRingBackend>::allocation_failed ||
+                offset % 256 != 0 || offset + size > ring.capacity()) {
+                failed = true;
+                continue;
+            }
+            ring.m_backend.track(offset, size);
+            bytes += size;
+        }
+        ring.end_frame();
+        failed |= ring.frames_queued() > RingBuffer<MockRingBackend>::frames_in_flight;
+    }
+    double total = elapsed_ms(start);
+
+    // A frame larger than the whole buffer can not be allocated.
+    ring.deinit();
+    failed |= ring.frames_queued() != 0 || !ring.m_backend.live.empty();
+    ring.init(1 << 10, 256);
+    failed |= ring.allocate(2 << 10) != RingBuffer<MockRingBackend>::allocation_failed;
+    ring.deinit();
+
+    std::println("ring  {:>8} frames: {:7.3f} ms, {} MB allocated, {} fence waits, {}", frame_count,
+                 total, bytes >> 20, ring.m_backend.waits,
+                 failed || ring.m_backend.overlap ? "BOOKKEEPING ERROR" : "bookkeeping ok");
+}
+
+int main() {
+    for (u32 item_count : {1'000u, 10'000u, 100'000u}) {
+        bench_render_queue(item_count, 8);
+        bench_render_queue(item_count, 256);
+    }
+    bench_culling(100'000);
+    check_ring_buffer();
+}
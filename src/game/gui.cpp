@@ -325,10 +325,16 @@ static void draw_node_editor(State& state) {
     ImGui::Begin("Node Properties", nullptr);
     if (state.hierarchy.m_nodes.size() != 0) {
         auto& node = state.hierarchy.m_nodes[editor.selected_node];
-        ImGui::DragFloat3("Translation", (f32*)glm::value_ptr(node.translation));
-        ImGui::DragFloat4("Rotation", (f32*)glm::value_ptr(node.rotation), 0.05f);
-        node.rotation = glm::normalize(node.rotation);
-        ImGui::DragFloat3("Scale", (f32*)glm::value_ptr(node.scale));
+        glm::vec3 translation = node.translation;
+        glm::quat rotation = node.rotation;
+        glm::vec3 scale = node.scale;
+        bool changed = ImGui::DragFloat3("Translation", (f32*)glm::value_ptr(translation));
+        changed |= ImGui::DragFloat4("Rotation", (f32*)glm::value_ptr(rotation), 0.05f);
+        changed |= ImGui::DragFloat3("Scale", (f32*)glm::value_ptr(scale));
+        if (changed) {
+            state.hierarchy.set_transform(engine::NodeHandle(editor.selected_node), translation,
+                                          glm::normalize(rotation), scale);
+        }
 
         static const char* preview_values[2] = {
             "Node",
@@ -385,7 +391,7 @@ void gui::build(State& state) {
 
     ImGui::NewFrame();
 
-    ImGui::SetNextWindowPos({ImGui::GetFontSize(), state.fb_height - 4.0f * ImGui::GetFontSize()});
+    ImGui::SetNextWindowPos({ImGui::GetFontSize(), state.fb_height - 5.5f * ImGui::GetFontSize()});
     ImGui::Begin("Metrics", nullptr,
                  ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse |
                      ImGuiWindowFlags_AlwaysAutoResize);
@@ -395,6 +401,20 @@ void gui::build(State& state) {
     }
     avg_delta_time *= (1.0f / (f32)state.prev_delta_times.size());
     ImGui::Text("%d FPS (%.3f ms)", (int)(1.0f / avg_delta_time), avg_delta_time * 1000.0f);
+    ImGui::Text("%u draw calls", state.renderer.get_draw_call_count());
+    ImGui::Text("%u / %u primitives visible", state.renderer.get_primitives_visible(),
+                state.renderer.get_primitives_tested());
+    if (state.renderer.get_meshlet_culling()) {
+        ImGui::Text("%u / %u meshlets visible", state.renderer.get_meshlets_visible(),
+                    state.renderer.get_meshlets_tested());
+    }
+    ImGui::Text("%u / %u / %u / %u primitives at LOD 0 / 1 / 2 / 3",
+                state.renderer.get_lod_draw_count(0), state.renderer.get_lod_draw_count(1),
+                state.renderer.get_lod_draw_count(2), state.renderer.get_lod_draw_count(3));
+    if (state.streamer.is_streaming()) {
+        ImGui::Text("%u / %u images streamed", state.streamer.get_num_finished(),
+                    state.streamer.get_num_images());
+    }
     ImGui::End();
 
     ImGui::Begin("Camera", nullptr);
@@ -412,6 +432,26 @@ void gui::build(State& state) {
             INFO("Changed vsync status");
         }
 
+        if (state.renderer.supports_indirect_submission()) {
+            bool indirect = state.renderer.get_submission_mode() ==
+                            engine::Renderer::SubmissionMode::indirect;
+            if (ImGui::Checkbox("Multi-draw indirect", &indirect)) {
+                state.renderer.set_submission_mode(indirect
+                                                       ? engine::Renderer::SubmissionMode::indirect
+                                                       : engine::Renderer::SubmissionMode::direct);
+            }
+        }
+
+        bool meshlet_culling = state.renderer.get_meshlet_culling();
+        if (ImGui::Checkbox("Meshlet culling", &meshlet_culling)) {
+            state.renderer.set_meshlet_culling(meshlet_culling);
+        }
+
+        f32 lod_error_threshold = state.renderer.get_lod_error_threshold();
+        if (ImGui::SliderFloat("LOD error (pixels)", &lod_error_threshold, 0.0f, 8.0f)) {
+            state.renderer.set_lod_error_threshold(lod_error_threshold);
+        }
+
         static int texture_filtering_rate = 1;
         auto msg_len =
             std::format_to_n(fmt_buf, sizeof(fmt_buf) - 1, "{}x", texture_filtering_rate);
@@ -4,6 +4,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "engine/AssetLoader.h"
+#include "engine/AssetStreamer.h"
 #include "engine/Input.h"
 #include "engine/Renderer.h"
 #include "engine/core.h"
@@ -104,10 +105,13 @@ int main(void) {
     state.sensitivity = 0.001f;
 
     state.renderer.init((engine::Renderer::LoadProc)glfwGetProcAddress);
+    state.streamer.init(2, 32 << 20);
     {
+        // Images are streamed in while the game runs, everything else is needed right away.
         auto data = engine::loader::load_asset_file("scene_data.bin");
         state.scene.init(data);
         state.renderer.make_resources_for_scene(data);
+        state.streamer.stream_images(state.scene, std::move(data));
     }
 
     engine::NodeHandle root_node = state.hierarchy.add_root_node({
@@ -233,14 +237,14 @@ int main(void) {
         glfwPollEvents();
         gui::build(state);
 
-        // Not the formal way to set a node transform. Just temporary
-        state.hierarchy.m_nodes[player.get_value()].translation = state.player.position;
-        state.hierarchy.m_nodes[player.get_value()].rotation = state.player.rotation;
-        state.hierarchy.m_nodes[player.get_value()].scale = state.player.scale;
+        state.hierarchy.set_transform(player, state.player.position, state.player.rotation,
+                                      state.player.scale);
+        state.hierarchy.set_transform(enemy, state.enemy.position, state.enemy.rotation,
+                                      state.enemy.scale);
 
-        state.hierarchy.m_nodes[enemy.get_value()].translation = state.enemy.position;
-        state.hierarchy.m_nodes[enemy.get_value()].rotation = state.enemy.rotation;
-        state.hierarchy.m_nodes[enemy.get_value()].scale = state.enemy.scale;
+        state.hierarchy.update_world_transforms();
+
+        state.streamer.update(state.scene, 2.0f);
 
         // Draw
         state.renderer.clear();
@@ -254,4 +258,6 @@ int main(void) {
 
         input.update();
     }
+
+    state.streamer.deinit();
 }
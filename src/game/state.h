@@ -1,5 +1,6 @@
 #include <array>
 
+#include "engine/AssetStreamer.h"
 #include "engine/Camera.h"
 #include "engine/Renderer.h"
 #include "engine/scene/Node.h"
@@ -11,6 +12,7 @@ struct State {
     engine::Scene scene;
     engine::Camera camera;
     engine::Renderer renderer;
+    engine::AssetStreamer streamer;
     engine::NodeHierarchy hierarchy;
 
     u32 fb_width;
@@ -5,6 +5,7 @@
 #include <stb_image.h>
 #include <tiny_gltf.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
@@ -23,6 +24,8 @@
 #include <glm/gtx/matrix_decompose.hpp>
 
 #include "../../../src/engine/utils/logging.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 
 constexpr bool verbose_accessor_logging = false;
 
@@ -270,6 +273,61 @@ void AssetImporter::load_asset(std::string path) {
     load_textures(model);
 }
 
+// Bounding box and sphere of the vertex positions. The sphere is Ritter's approximation, or the
+// sphere around the box center when that one happens to be tighter.
+static Bounds compute_bounds(std::span<const Vertex> vertices) {
+    assert(vertices.size() > 0);
+
+    Bounds bounds;
+    bounds.aabb_min = vertices[0].pos;
+    bounds.aabb_max = vertices[0].pos;
+    for (const auto &vertex : vertices) {
+        bounds.aabb_min = glm::min(bounds.aabb_min, vertex.pos);
+        bounds.aabb_max = glm::max(bounds.aabb_max, vertex.pos);
+    }
+
+    auto farthest_from = [&](glm::vec3 point) {
+        glm::vec3 result = point;
+        f32 max_distance = -1.0f;
+        for (const auto &vertex : vertices) {
+            f32 distance = glm::dot(vertex.pos - point, vertex.pos - point);
+            if (distance > max_distance) {
+                max_distance = distance;
+                result = vertex.pos;
+            }
+        }
+        return result;
+    };
+
+    glm::vec3 a = farthest_from(vertices[0].pos);
+    glm::vec3 b = farthest_from(a);
+    glm::vec3 center = (a + b) * 0.5f;
+    f32 radius = glm::length(b - a) * 0.5f;
+    for (const auto &vertex : vertices) {
+        f32 distance = glm::length(vertex.pos - center);
+        if (distance > radius) {
+            // Grow the sphere just enough to include the point.
+            f32 new_radius = (radius + distance) * 0.5f;
+            center += (vertex.pos - center) * ((new_radius - radius) / distance);
+            radius = new_radius;
+        }
+    }
+
+    glm::vec3 box_center = (bounds.aabb_min + bounds.aabb_max) * 0.5f;
+    f32 box_radius = 0.0f;
+    for (const auto &vertex : vertices) {
+        box_radius = std::max(box_radius, glm::length(vertex.pos - box_center));
+    }
+    if (box_radius < radius) {
+        center = box_center;
+        radius = box_radius;
+    }
+
+    bounds.sphere_center = center;
+    bounds.sphere_radius = radius;
+    return bounds;
+}
+
 void AssetImporter::load_meshes(const tinygltf::Model &model) {
     assert(model.meshes.size() != 0);
 
@@ -281,20 +339,27 @@ void AssetImporter::load_meshes(const tinygltf::Model &model) {
         }
 
         u32 prim_index = m_primitives.size();
+        u32 base_vertex = m_vertices.size();
 
+        MeshOptimizationReport report;
         for (const auto &prim : mesh.primitives) {
-            load_primitive(model, prim);
+            report.add(load_primitive(model, prim));
         }
+        INFO("Mesh {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}, {} -> {} vertices", mesh.name,
+             report.before.acmr(), report.after.acmr(), report.before.atvr(), report.after.atvr(),
+             report.num_vertices_before, report.num_vertices_after);
 
         m_meshes.push_back({
             .primitive_index = prim_index,
             .num_primitives = (u32)mesh.primitives.size(),
             .node_index = UINT32_MAX,
+            .bounds = compute_bounds(std::span(m_vertices).subspan(base_vertex)),
         });
     }
 }
 
-void AssetImporter::load_primitive(const tinygltf::Model &model, const tinygltf::Primitive &prim) {
+MeshOptimizationReport AssetImporter::load_primitive(const tinygltf::Model &model,
+                                                     const tinygltf::Primitive &prim) {
     assert(prim.indices >= 0);
 
     u32 base_vertex = m_vertices.size();
@@ -317,8 +382,74 @@ void AssetImporter::load_primitive(const tinygltf::Model &model, const tinygltf:
     dump_accessor_append(m_indices, model, indices_accessor, true);
     load_vertices(model, prim);
 
+    // The indices are relative to the first vertex of the primitive.
+    std::vector<u32> indices(indices_accessor.count);
+    std::vector<Vertex> vertices(m_vertices.begin() + base_vertex, m_vertices.end());
+    bool is_u16 = indices_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (is_u16) {
+            indices[i] = ((const u16 *)&m_indices[indices_start])[i];
+        } else {
+            indices[i] = ((const u32 *)&m_indices[indices_start])[i];
+        }
+    }
+
+    // Never adds vertices, so the index type stays valid.
+    MeshOptimizationReport report = optimize_mesh(vertices, indices);
+
+    m_vertices.resize(base_vertex);
+    m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (is_u16) {
+            ((u16 *)&m_indices[indices_start])[i] = (u16)indices[i];
+        } else {
+            ((u32 *)&m_indices[indices_start])[i] = indices[i];
+        }
+    }
+
     u32 indices_end = m_indices.size();
 
+    u32 meshlet_index = m_meshlets.size();
+    std::vector<Meshlet> meshlets = build_meshlets(indices, vertices);
+    m_meshlets.insert(m_meshlets.end(), meshlets.begin(), meshlets.end());
+
+    // Every level of detail aims for half the triangles of the previous one. They are simplified
+    // from the full primitive so the error is relative to it, and follow it in the index buffer.
+    PrimitiveLod lods[max_primitive_lods] = {};
+    lods[0] = {.indices_start = indices_start, .indices_end = indices_end, .error = 0.0f};
+    u32 num_lods = 1;
+    std::string lod_log = std::format("{}", indices.size() / 3);
+    for (; num_lods < max_primitive_lods; ++num_lods) {
+        f32 error;
+        std::vector<u32> lod_indices =
+            simplify_mesh(indices, vertices, (indices.size() >> num_lods) / 3 * 3, error);
+        // Not worth a level when seams and borders kept the simplification from getting far.
+        u32 previous_count = (lods[num_lods - 1].indices_end - lods[num_lods - 1].indices_start) /
+                             (is_u16 ? 2 : 4);
+        if (lod_indices.empty() || lod_indices.size() > previous_count * 3 / 4) break;
+        optimize_vertex_cache(lod_indices, vertices.size());
+
+        while (m_indices.size() % 4 != 0) {
+            m_indices.push_back(0);
+        }
+        u32 lod_start = m_indices.size();
+        m_indices.resize(lod_start + lod_indices.size() * (is_u16 ? 2 : 4));
+        for (size_t i = 0; i < lod_indices.size(); ++i) {
+            if (is_u16) {
+                ((u16 *)&m_indices[lod_start])[i] = (u16)lod_indices[i];
+            } else {
+                ((u32 *)&m_indices[lod_start])[i] = lod_indices[i];
+            }
+        }
+        lods[num_lods] = {
+            .indices_start = lod_start,
+            .indices_end = (u32)m_indices.size(),
+            .error = error,
+        };
+        lod_log += std::format(" -> {} ({:.4f})", lod_indices.size() / 3, error);
+    }
+    INFO("Primitive {} LOD triangles (error): {}", m_primitives.size(), lod_log);
+
     m_primitives.push_back({
         .base_vertex = base_vertex,
         .num_vertices = (u32)m_vertices.size() - base_vertex,
@@ -326,7 +457,13 @@ void AssetImporter::load_primitive(const tinygltf::Model &model, const tinygltf:
         .indices_end = indices_end,
         .index_type = (u32)indices_accessor.componentType,
         .material_index = m_base_material + (u32)prim.material,
+        .bounds = compute_bounds(std::span(m_vertices).subspan(base_vertex)),
+        .meshlet_index = meshlet_index,
+        .num_meshlets = (u32)meshlets.size(),
+        .num_lods = num_lods,
     });
+    std::copy(std::begin(lods), std::end(lods), m_primitives.back().lods);
+    return report;
 }
 
 void AssetImporter::load_vertices(const tinygltf::Model &model, const tinygltf::Primitive prim) {
@@ -821,4 +958,82 @@ void AssetImporter::load_prefab(std::span<const ImmutableNode> nodes) {
         new_node.child_index += base_node;
         m_prefabs_nodes.push_back(new_node);
     }
-}
\ No newline at end of file
+}
+
+static u16 float_to_half(f32 value) {
+    u32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    u32 sign = (bits >> 16) & 0x8000;
+    i32 exponent = (i32)((bits >> 23) & 0xff) - 127 + 15;
+    u32 mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0) {
+        // Subnormal half, or zero when it is too small.
+        if (exponent < -10) return sign;
+        mantissa |= 0x800000;
+        u32 shift = 14 - exponent;
+        u32 half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+        return sign | half;
+    }
+    if (exponent >= 31) {
+        return sign | 0x7c00;
+    }
+
+    // Rounding can carry into the exponent, which is still the right result.
+    u32 half = sign | ((u32)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;
+    return half;
+}
+
+static i16 float_to_snorm16(f32 value) {
+    return (i16)std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+// Maps the unit sphere onto the [-1, 1] square: project onto the octahedron |x| + |y| + |z| = 1
+// and fold the lower half over the diagonals.
+static void octahedral_encode(glm::vec3 v, i16 out[2]) {
+    f32 length = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+    if (length == 0.0f) {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+    v /= length;
+    f32 x = v.x;
+    f32 y = v.y;
+    if (v.z < 0.0f) {
+        x = (1.0f - std::abs(v.y)) * (v.x >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::abs(v.x)) * (v.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    out[0] = float_to_snorm16(x);
+    out[1] = float_to_snorm16(y);
+}
+
+void AssetImporter::pack_vertices() {
+    m_packed_vertices.resize(m_vertices.size());
+
+    for (const auto &prim : m_primitives) {
+        glm::vec3 aabb_min = prim.bounds.aabb_min;
+        glm::vec3 extent = prim.bounds.aabb_max - prim.bounds.aabb_min;
+
+        for (u32 i = prim.base_vertex; i < prim.base_vertex + prim.num_vertices; ++i) {
+            const auto &vertex = m_vertices[i];
+            auto &packed = m_packed_vertices[i];
+
+            for (u32 axis = 0; axis < 3; ++axis) {
+                f32 t = extent[axis] > 0.0f ? (vertex.pos[axis] - aabb_min[axis]) / extent[axis] : 0.0f;
+                packed.pos[axis] = (u16)std::round(glm::clamp(t, 0.0f, 1.0f) * 65535.0f);
+            }
+            packed.pos[3] = vertex.tangent.w >= 0.0f ? 65535 : 0;
+
+            octahedral_encode(vertex.normal, packed.normal);
+            octahedral_encode(glm::vec3(vertex.tangent), packed.tangent);
+            packed.uv[0] = float_to_half(vertex.uv.x);
+            packed.uv[1] = float_to_half(vertex.uv.y);
+        }
+    }
+
+    INFO("Packed {} vertices, {} bytes instead of {}", m_vertices.size(),
+         m_packed_vertices.size() * sizeof(PackedVertex), m_vertices.size() * sizeof(Vertex));
+}
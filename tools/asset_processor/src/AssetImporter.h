@@ -8,6 +8,7 @@
 #include <unordered_map>
 
 #include "../../../src/engine/AssetLoader.h"
+#include "MeshOptimizer.h"
 
 
 using namespace engine::loader;
@@ -31,8 +32,11 @@ struct AssetImporter {
 
     std::vector<u8> m_indices;
     std::vector<Vertex> m_vertices;
+    // m_vertices in the format of the asset file, filled by pack_vertices.
+    std::vector<PackedVertex> m_packed_vertices;
     std::vector<Mesh> m_meshes;
     std::vector<Primitive> m_primitives;
+    std::vector<Meshlet> m_meshlets;
 
     std::vector<ImmutableNode> m_prefabs_nodes;
     std::vector<u32> m_root_prefab_nodes;
@@ -47,7 +51,8 @@ struct AssetImporter {
     void load_indices(const tinygltf::Model& model, const tinygltf::Accessor accessor);
     void load_vertices(const tinygltf::Model& model, const tinygltf::Primitive prim);
     void load_node(const tinygltf::Model& model, u32 gltf_node_index, u32 our_node_index);
-    void load_primitive(const tinygltf::Model& model, const tinygltf::Primitive& prim);
+    // Loads the primitive and optimizes it for the vertex cache, overdraw and vertex fetch.
+    MeshOptimizationReport load_primitive(const tinygltf::Model& model, const tinygltf::Primitive& prim);
     void load_meshes(const tinygltf::Model& model);
     void load_nodes(const tinygltf::Model& model);
     void load_textures(const tinygltf::Model& model);
@@ -62,6 +67,7 @@ struct AssetImporter {
                                         std::string_view path);
     std::string get_image_cache_path(std::span<const u8> image_data, const ImageInfo& image);
     void load_prefab(std::span<const ImmutableNode> nodes);
+    void pack_vertices();
 };
 
 #endif
@@ -0,0 +1,373 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+VertexCacheStats analyze_vertex_cache(std::span<const u32> indices, u32 num_vertices,
+                                      u32 cache_size) {
+    VertexCacheStats stats;
+    stats.num_triangles = indices.size() / 3;
+
+    // A vertex is in the FIFO when it was added less than cache_size misses ago.
+    std::vector<u32> added_at(num_vertices, UINT32_MAX);
+    std::vector<bool> referenced(num_vertices, false);
+    for (u32 index : indices) {
+        if (added_at[index] == UINT32_MAX || stats.num_transformed - added_at[index] >= cache_size) {
+            added_at[index] = stats.num_transformed;
+            stats.num_transformed++;
+        }
+        if (!referenced[index]) {
+            referenced[index] = true;
+            stats.num_vertices++;
+        }
+    }
+    return stats;
+}
+
+void deduplicate_vertices(std::vector<Vertex>& vertices, std::span<u32> indices) {
+    std::vector<u32> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto compare = [&](u32 a, u32 b) {
+        return std::memcmp(&vertices[a], &vertices[b], sizeof(Vertex));
+    };
+    std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) { return compare(a, b) < 0; });
+
+    // Every vertex is remapped to the first of its duplicates.
+    std::vector<u32> remap(vertices.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        bool duplicate = i > 0 && compare(order[i - 1], order[i]) == 0;
+        remap[order[i]] = duplicate ? remap[order[i - 1]] : order[i];
+    }
+    for (u32& index : indices) {
+        index = remap[index];
+    }
+    // The now unused duplicates are removed by optimize_vertex_fetch.
+}
+
+std::vector<u32> optimize_vertex_cache(std::span<u32> indices, u32 num_vertices, u32 cache_size) {
+    u32 num_triangles = indices.size() / 3;
+
+    // Triangles using each vertex.
+    std::vector<u32> live_triangles(num_vertices, 0);
+    for (u32 index : indices) {
+        live_triangles[index]++;
+    }
+    std::vector<u32> adjacency_offsets(num_vertices + 1, 0);
+    for (u32 v = 0; v < num_vertices; ++v) {
+        adjacency_offsets[v + 1] = adjacency_offsets[v] + live_triangles[v];
+    }
+    std::vector<u32> adjacency(indices.size());
+    {
+        std::vector<u32> fill = adjacency_offsets;
+        for (u32 t = 0; t < num_triangles; ++t) {
+            for (u32 c = 0; c < 3; ++c) {
+                adjacency[fill[indices[t * 3 + c]]++] = t;
+            }
+        }
+    }
+
+    std::vector<u32> cache_time(num_vertices, 0);
+    std::vector<bool> emitted(num_triangles, false);
+    std::vector<u32> dead_end_stack;
+    std::vector<u32> candidates;
+    std::vector<u32> result;
+    result.reserve(indices.size());
+    std::vector<u32> cluster_starts;
+
+    u32 time = cache_size + 1;
+    u32 cursor = 0;
+    i64 fanning_vertex = num_vertices > 0 ? 0 : -1;
+    bool hard_boundary = true;
+
+    while (fanning_vertex >= 0) {
+        if (hard_boundary) {
+            cluster_starts.push_back(result.size() / 3);
+            hard_boundary = false;
+        }
+
+        candidates.clear();
+        u32 v = (u32)fanning_vertex;
+        for (u32 a = adjacency_offsets[v]; a < adjacency_offsets[v + 1]; ++a) {
+            u32 t = adjacency[a];
+            if (emitted[t]) continue;
+
+            for (u32 c = 0; c < 3; ++c) {
+                u32 w = indices[t * 3 + c];
+                result.push_back(w);
+                dead_end_stack.push_back(w);
+                candidates.push_back(w);
+                live_triangles[w]--;
+                if (time - cache_time[w] > cache_size) {
+                    cache_time[w] = time;
+                    time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // The next fanning vertex is the candidate that is still in the cache and will stay in it
+        // while its remaining triangles are emitted, preferring the oldest one.
+        fanning_vertex = -1;
+        i64 best_priority = -1;
+        for (u32 w : candidates) {
+            if (live_triangles[w] == 0) continue;
+            i64 priority = 0;
+            if (time - cache_time[w] + 2 * live_triangles[w] <= cache_size) {
+                priority = time - cache_time[w];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                fanning_vertex = w;
+            }
+        }
+
+        if (fanning_vertex == -1) {
+            // Dead end, continue with a recently used vertex or the next unfinished vertex.
+            hard_boundary = true;
+            while (!dead_end_stack.empty()) {
+                u32 w = dead_end_stack.back();
+                dead_end_stack.pop_back();
+                if (live_triangles[w] > 0) {
+                    fanning_vertex = w;
+                    break;
+                }
+            }
+            while (fanning_vertex == -1 && cursor < num_vertices) {
+                if (live_triangles[cursor] > 0) {
+                    fanning_vertex = cursor;
+                }
+                cursor++;
+            }
+        }
+    }
+
+    assert(result.size() == indices.size());
+    std::copy(result.begin(), result.end(), indices.begin());
+
+    // Restarting from the dead end stack does not empty the cache, so hard boundaries alone make
+    // few and large clusters. Split further where the cache behaves as well in the cluster as in
+    // the whole mesh, which is where a cluster can be moved without a lot of extra misses.
+    // This is the soft boundary of the paper with lambda = 1.
+    const u32 min_cluster_triangles = 64;
+    f32 mesh_acmr = analyze_vertex_cache(indices, num_vertices, cache_size).acmr();
+
+    std::vector<u32> clusters;
+    std::vector<u32> added_at(num_vertices, UINT32_MAX);
+    u32 transformed = 0;
+    u32 cluster_start = 0;
+    u32 cluster_transformed = 0;
+    u32 next_hard = 0;
+    for (u32 t = 0; t < num_triangles; ++t) {
+        bool is_hard = next_hard < cluster_starts.size() && cluster_starts[next_hard] == t;
+        if (is_hard) next_hard++;
+
+        u32 cluster_triangles = t - cluster_start;
+        bool is_soft = cluster_triangles >= min_cluster_triangles &&
+                       (f32)cluster_transformed / cluster_triangles <= mesh_acmr;
+        if (t == 0 || is_hard || is_soft) {
+            clusters.push_back(t);
+            cluster_start = t;
+            cluster_transformed = 0;
+            // Vertices of the previous cluster can not be counted on after reordering.
+            transformed += cache_size;
+        }
+
+        for (u32 c = 0; c < 3; ++c) {
+            u32 index = indices[t * 3 + c];
+            if (added_at[index] == UINT32_MAX || transformed - added_at[index] >= cache_size) {
+                added_at[index] = transformed;
+                transformed++;
+                cluster_transformed++;
+            }
+        }
+    }
+    return clusters;
+}
+
+void optimize_overdraw(std::span<u32> indices, std::span<const u32> cluster_starts,
+                       std::span<const Vertex> vertices) {
+    u32 num_triangles = indices.size() / 3;
+    u32 num_clusters = cluster_starts.size();
+    if (num_clusters < 2) return;
+
+    auto triangle = [&](u32 t, glm::vec3& a, glm::vec3& b, glm::vec3& c) {
+        a = vertices[indices[t * 3 + 0]].pos;
+        b = vertices[indices[t * 3 + 1]].pos;
+        c = vertices[indices[t * 3 + 2]].pos;
+    };
+
+    // Area weighted centroids and normals.
+    glm::vec3 mesh_centroid(0.0f);
+    f32 mesh_area = 0.0f;
+    std::vector<glm::vec3> centroids(num_clusters, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(num_clusters, glm::vec3(0.0f));
+    std::vector<f32> areas(num_clusters, 0.0f);
+    for (u32 cluster = 0; cluster < num_clusters; ++cluster) {
+        u32 end = cluster + 1 < num_clusters ? cluster_starts[cluster + 1] : num_triangles;
+        for (u32 t = cluster_starts[cluster]; t < end; ++t) {
+            glm::vec3 a, b, c;
+            triangle(t, a, b, c);
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            f32 area = glm::length(normal);
+            centroids[cluster] += (a + b + c) * (area / 3.0f);
+            normals[cluster] += normal;
+            areas[cluster] += area;
+        }
+        mesh_centroid += centroids[cluster];
+        mesh_area += areas[cluster];
+    }
+    if (mesh_area == 0.0f) return;
+    mesh_centroid = mesh_centroid * (1.0f / mesh_area);
+
+    std::vector<f32> sort_keys(num_clusters, 0.0f);
+    for (u32 cluster = 0; cluster < num_clusters; ++cluster) {
+        if (areas[cluster] == 0.0f) continue;
+        glm::vec3 centroid = centroids[cluster] * (1.0f / areas[cluster]);
+        f32 normal_length = glm::length(normals[cluster]);
+        if (normal_length == 0.0f) continue;
+        sort_keys[cluster] = glm::dot(centroid - mesh_centroid, normals[cluster] * (1.0f / normal_length));
+    }
+
+    std::vector<u32> order(num_clusters);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](u32 a, u32 b) { return sort_keys[a] > sort_keys[b]; });
+
+    std::vector<u32> result;
+    result.reserve(indices.size());
+    for (u32 cluster : order) {
+        u32 end = cluster + 1 < num_clusters ? cluster_starts[cluster + 1] : num_triangles;
+        result.insert(result.end(), indices.begin() + cluster_starts[cluster] * 3,
+                      indices.begin() + end * 3);
+    }
+    std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::span<u32> indices) {
+    std::vector<u32> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (u32& index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = result.size();
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(result);
+}
+
+MeshOptimizationReport optimize_mesh(std::vector<Vertex>& vertices, std::span<u32> indices) {
+    MeshOptimizationReport report;
+    report.num_vertices_before = vertices.size();
+    report.before = analyze_vertex_cache(indices, vertices.size());
+
+    deduplicate_vertices(vertices, indices);
+    std::vector<u32> clusters = optimize_vertex_cache(indices, vertices.size());
+    optimize_overdraw(indices, clusters, vertices);
+    optimize_vertex_fetch(vertices, indices);
+
+    report.num_vertices_after = vertices.size();
+    report.after = analyze_vertex_cache(indices, vertices.size());
+    return report;
+}
+
+static Meshlet make_meshlet(std::span<const u32> indices, std::span<const Vertex> vertices,
+                            u32 first_triangle, u32 end_triangle) {
+    glm::vec3 aabb_min(FLT_MAX);
+    glm::vec3 aabb_max(-FLT_MAX);
+    for (u32 i = first_triangle * 3; i < end_triangle * 3; ++i) {
+        aabb_min = glm::min(aabb_min, vertices[indices[i]].pos);
+        aabb_max = glm::max(aabb_max, vertices[indices[i]].pos);
+    }
+    glm::vec3 center = (aabb_min + aabb_max) * 0.5f;
+    f32 radius = 0.0f;
+    for (u32 i = first_triangle * 3; i < end_triangle * 3; ++i) {
+        radius = std::max(radius, glm::length(vertices[indices[i]].pos - center));
+    }
+
+    std::vector<glm::vec3> normals;
+    normals.reserve(end_triangle - first_triangle);
+    glm::vec3 normal_sum(0.0f);
+    for (u32 t = first_triangle; t < end_triangle; ++t) {
+        glm::vec3 a = vertices[indices[t * 3 + 0]].pos;
+        glm::vec3 b = vertices[indices[t * 3 + 1]].pos;
+        glm::vec3 c = vertices[indices[t * 3 + 2]].pos;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        f32 length = glm::length(normal);
+        // Degenerate triangles are never rasterized and do not constrain the cone.
+        if (length == 0.0f) continue;
+        normal = normal * (1.0f / length);
+        normals.push_back(normal);
+        normal_sum += normal;
+    }
+
+    // The axis is the average normal and the cone is as wide as the normal furthest from it. A
+    // cone of more than 90 degrees has no backfacing view direction, cone_cutoff = 1 marks that.
+    glm::vec3 axis(0.0f, 0.0f, 1.0f);
+    f32 cutoff = 1.0f;
+    f32 sum_length = glm::length(normal_sum);
+    if (sum_length > 0.0f) {
+        axis = normal_sum * (1.0f / sum_length);
+        f32 min_dot = 1.0f;
+        for (const auto& normal : normals) {
+            min_dot = std::min(min_dot, glm::dot(normal, axis));
+        }
+        if (min_dot > 0.0f) {
+            cutoff = std::sqrt(1.0f - min_dot * min_dot);
+        }
+    }
+
+    return {
+        .sphere_center = center,
+        .sphere_radius = radius,
+        .cone_axis = axis,
+        .cone_cutoff = cutoff,
+        .index_offset = first_triangle * 3,
+        .num_triangles = end_triangle - first_triangle,
+    };
+}
+
+std::vector<Meshlet> build_meshlets(std::span<const u32> indices, std::span<const Vertex> vertices,
+                                    u32 max_vertices, u32 max_triangles) {
+    assert(max_vertices >= 3 && max_triangles >= 1);
+    u32 num_triangles = indices.size() / 3;
+    std::vector<Meshlet> meshlets;
+
+    // The meshlet a vertex was last added to, so it is only counted once per meshlet.
+    std::vector<u32> vertex_meshlet(vertices.size(), UINT32_MAX);
+    u32 meshlet = 0;
+    u32 meshlet_start = 0;
+    u32 meshlet_vertices = 0;
+
+    auto count_new_vertices = [&](u32 t) {
+        u32 a = indices[t * 3 + 0], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+        u32 count = vertex_meshlet[a] != meshlet;
+        count += vertex_meshlet[b] != meshlet && b != a;
+        count += vertex_meshlet[c] != meshlet && c != a && c != b;
+        return count;
+    };
+
+    for (u32 t = 0; t < num_triangles; ++t) {
+        u32 new_vertices = count_new_vertices(t);
+        if (t - meshlet_start == max_triangles || meshlet_vertices + new_vertices > max_vertices) {
+            meshlets.push_back(make_meshlet(indices, vertices, meshlet_start, t));
+            meshlet++;
+            meshlet_start = t;
+            meshlet_vertices = 0;
+            new_vertices = count_new_vertices(t);
+        }
+        for (u32 c = 0; c < 3; ++c) {
+            vertex_meshlet[indices[t * 3 + c]] = meshlet;
+        }
+        meshlet_vertices += new_vertices;
+    }
+    if (meshlet_start < num_triangles) {
+        meshlets.push_back(make_meshlet(indices, vertices, meshlet_start, num_triangles));
+    }
+    return meshlets;
+}
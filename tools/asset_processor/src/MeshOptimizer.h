@@ -0,0 +1,81 @@
+#ifndef _MESH_OPTIMIZER_H
+#define _MESH_OPTIMIZER_H
+
+#include <span>
+#include <vector>
+
+#include "../../../src/engine/scene/Scene.h"
+
+using namespace engine;
+
+// Post transform vertex cache statistics of an index buffer, measured with a FIFO cache.
+struct VertexCacheStats {
+    u32 num_triangles = 0;
+    // Vertices referenced by the indices.
+    u32 num_vertices = 0;
+    // Vertex shader invocations, cache misses.
+    u32 num_transformed = 0;
+
+    // Average cache miss ratio, transformed vertices per triangle. 0.5 is the lower bound for
+    // large regular meshes, 3 is the worst case.
+    f32 acmr() const { return num_triangles ? (f32)num_transformed / num_triangles : 0.0f; }
+    // Average transform to vertex ratio, 1 is optimal.
+    f32 atvr() const { return num_vertices ? (f32)num_transformed / num_vertices : 0.0f; }
+
+    void add(const VertexCacheStats& other) {
+        num_triangles += other.num_triangles;
+        num_vertices += other.num_vertices;
+        num_transformed += other.num_transformed;
+    }
+};
+
+struct MeshOptimizationReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    u32 num_vertices_before = 0;
+    u32 num_vertices_after = 0;
+
+    void add(const MeshOptimizationReport& other) {
+        before.add(other.before);
+        after.add(other.after);
+        num_vertices_before += other.num_vertices_before;
+        num_vertices_after += other.num_vertices_after;
+    }
+};
+
+constexpr u32 vertex_cache_size = 16;
+
+VertexCacheStats analyze_vertex_cache(std::span<const u32> indices, u32 num_vertices,
+                                      u32 cache_size = vertex_cache_size);
+
+// Merges bit identical vertices and rewrites the indices to the remaining ones.
+void deduplicate_vertices(std::vector<Vertex>& vertices, std::span<u32> indices);
+
+// Reorders the triangles for the post transform vertex cache with Tipsify (Sander, Nehab and
+// Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"). Returns the
+// index of the first triangle of every cluster, triangles of a cluster can be moved as a whole
+// without hurting the cache much.
+std::vector<u32> optimize_vertex_cache(std::span<u32> indices, u32 num_vertices,
+                                       u32 cache_size = vertex_cache_size);
+
+// Orders the clusters so that the ones facing outwards from the center of the mesh, which are
+// likely to occlude the others, are drawn first.
+void optimize_overdraw(std::span<u32> indices, std::span<const u32> cluster_starts,
+                       std::span<const Vertex> vertices);
+
+// Renumbers the vertices in the order they are first used so vertex fetches are sequential,
+// unused vertices are removed.
+void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::span<u32> indices);
+
+// Runs all of the above.
+MeshOptimizationReport optimize_mesh(std::vector<Vertex>& vertices, std::span<u32> indices);
+
+// Splits the triangles into meshlets of at most max_vertices unique vertices and max_triangles
+// triangles. The triangles are not reordered, meshlets are consecutive runs of them, so the vertex
+// cache order of optimize_mesh is kept and already groups nearby triangles. Index offsets of the
+// meshlets are relative to the start of indices.
+std::vector<Meshlet> build_meshlets(std::span<const u32> indices, std::span<const Vertex> vertices,
+                                    u32 max_vertices = max_meshlet_vertices,
+                                    u32 max_triangles = max_meshlet_triangles);
+
+#endif
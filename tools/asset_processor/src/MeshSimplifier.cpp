@@ -0,0 +1,375 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+// Sum of weighted squared distances to a set of planes, the symmetric 4x4 matrix of the
+// quadratic form.
+struct Quadric {
+    double xx = 0, xy = 0, xz = 0, xw = 0;
+    double yy = 0, yz = 0, yw = 0;
+    double zz = 0, zw = 0;
+    double ww = 0;
+    // Sum of the plane weights, so the error can be normalized to a squared distance.
+    double weight = 0;
+
+    void add_plane(glm::vec3 normal, f32 distance, double plane_weight) {
+        double a = normal.x, b = normal.y, c = normal.z, d = distance;
+        xx += plane_weight * a * a;
+        xy += plane_weight * a * b;
+        xz += plane_weight * a * c;
+        xw += plane_weight * a * d;
+        yy += plane_weight * b * b;
+        yz += plane_weight * b * c;
+        yw += plane_weight * b * d;
+        zz += plane_weight * c * c;
+        zw += plane_weight * c * d;
+        ww += plane_weight * d * d;
+        weight += plane_weight;
+    }
+
+    void add(const Quadric& other) {
+        xx += other.xx;
+        xy += other.xy;
+        xz += other.xz;
+        xw += other.xw;
+        yy += other.yy;
+        yz += other.yz;
+        yw += other.yw;
+        zz += other.zz;
+        zw += other.zw;
+        ww += other.ww;
+        weight += other.weight;
+    }
+
+    // Weighted mean of the squared distances from p to the planes.
+    double error(glm::vec3 p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double value = xx * x * x + yy * y * y + zz * z * z + ww +
+                       2.0 * (xy * x * y + xz * x * z + yz * y * z + xw * x + yw * y + zw * z);
+        return weight > 0.0 ? std::abs(value) / weight : 0.0;
+    }
+};
+
+enum class VertexKind : u8 {
+    interior,
+    border,
+    // Seams and non-manifold vertices.
+    locked,
+};
+
+// Removes from, every triangle using it uses to instead.
+struct Collapse {
+    u32 from;
+    u32 to;
+    double cost;
+};
+
+static u64 edge_key(u32 a, u32 b) {
+    if (a > b) std::swap(a, b);
+    return ((u64)a << 32) | b;
+}
+
+// Closest point on the triangle, from Ericson, "Real-Time Collision Detection" 5.1.5.
+static f32 distance_to_triangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    f32 d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return glm::length(p - a);
+
+    glm::vec3 bp = p - b;
+    f32 d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return glm::length(p - b);
+
+    f32 vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+    }
+
+    glm::vec3 cp = p - c;
+    f32 d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return glm::length(p - c);
+
+    f32 vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+    }
+
+    f32 va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+    }
+
+    f32 denom = 1.0f / (va + vb + vc);
+    return glm::length(p - (a + ab * (vb * denom) + ac * (vc * denom)));
+}
+
+// Planes through the border edges, perpendicular to their triangle, keep the outline of open
+// meshes in place.
+constexpr f32 border_weight = 10.0f;
+
+std::vector<u32> simplify_mesh(std::span<const u32> indices, std::span<const Vertex> vertices,
+                               u32 target_index_count, f32& error) {
+    u32 num_vertices = vertices.size();
+    std::vector<u32> result(indices.begin(), indices.end());
+    error = 0.0f;
+
+    // Vertices at the same position get the same position index, topology is built from those
+    // so that seams do not look like borders.
+    std::vector<u32> position_of(num_vertices);
+    std::vector<u32> wedges(num_vertices, 0);
+    {
+        std::vector<u32> order(num_vertices);
+        std::iota(order.begin(), order.end(), 0);
+        auto compare = [&](u32 a, u32 b) {
+            return std::memcmp(&vertices[a].pos, &vertices[b].pos, sizeof(glm::vec3));
+        };
+        std::sort(order.begin(), order.end(), [&](u32 a, u32 b) { return compare(a, b) < 0; });
+        for (size_t i = 0; i < order.size(); ++i) {
+            bool same = i > 0 && compare(order[i - 1], order[i]) == 0;
+            position_of[order[i]] = same ? position_of[order[i - 1]] : order[i];
+        }
+        for (u32 v = 0; v < num_vertices; ++v) {
+            wedges[position_of[v]]++;
+        }
+    }
+
+    std::unordered_map<u64, u32> edge_counts;
+    auto count_edges = [&]() {
+        edge_counts.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (u32 e = 0; e < 3; ++e) {
+                u32 a = result[i + e], b = result[i + (e + 1) % 3];
+                edge_counts[edge_key(position_of[a], position_of[b])]++;
+            }
+        }
+    };
+    auto edge_count = [&](u32 a, u32 b) {
+        auto it = edge_counts.find(edge_key(position_of[a], position_of[b]));
+        return it == edge_counts.end() ? 0u : it->second;
+    };
+
+    std::vector<Quadric> quadrics(num_vertices);
+    count_edges();
+    for (size_t i = 0; i < result.size(); i += 3) {
+        glm::vec3 p[3] = {vertices[result[i]].pos, vertices[result[i + 1]].pos,
+                          vertices[result[i + 2]].pos};
+        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        f32 length = glm::length(normal);
+        if (length == 0.0f) continue;
+        normal = normal * (1.0f / length);
+
+        // Area weighted, so many small triangles count as much as one large one.
+        for (u32 c = 0; c < 3; ++c) {
+            quadrics[result[i + c]].add_plane(normal, -glm::dot(normal, p[0]), length * 0.5f);
+        }
+
+        for (u32 e = 0; e < 3; ++e) {
+            u32 a = result[i + e], b = result[i + (e + 1) % 3];
+            if (edge_count(a, b) != 1) continue;
+            glm::vec3 edge = p[(e + 1) % 3] - p[e];
+            glm::vec3 border_normal = glm::cross(edge, normal);
+            f32 border_length = glm::length(border_normal);
+            if (border_length == 0.0f) continue;
+            border_normal = border_normal * (1.0f / border_length);
+            f32 distance = -glm::dot(border_normal, p[e]);
+            f32 weight = glm::dot(edge, edge) * border_weight;
+            quadrics[a].add_plane(border_normal, distance, weight);
+            quadrics[b].add_plane(border_normal, distance, weight);
+        }
+    }
+
+    std::vector<VertexKind> kinds(num_vertices);
+    // The triangles of vertex v are adjacency[adjacency_offsets[v]..adjacency_offsets[v + 1]].
+    std::vector<u32> adjacency_offsets;
+    std::vector<u32> adjacency;
+    auto build_adjacency = [&]() {
+        adjacency_offsets.assign(num_vertices + 1, 0);
+        for (u32 index : result) {
+            adjacency_offsets[index + 1]++;
+        }
+        for (u32 v = 0; v < num_vertices; ++v) {
+            adjacency_offsets[v + 1] += adjacency_offsets[v];
+        }
+        adjacency.resize(result.size());
+        std::vector<u32> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (u32 t = 0; t < result.size() / 3; ++t) {
+            for (u32 c = 0; c < 3; ++c) {
+                adjacency[fill[result[t * 3 + c]]++] = t;
+            }
+        }
+    };
+    std::vector<Collapse> collapses;
+    std::vector<u32> collapse_to(num_vertices);
+    std::vector<u8> touched(num_vertices);
+    std::vector<u32> simplified;
+    // The vertex that every vertex has been collapsed into, itself while it is kept.
+    std::vector<u32> representative(num_vertices);
+    std::iota(representative.begin(), representative.end(), 0);
+
+    // Moving a vertex must not turn any of its remaining triangles over, compared to the triangle
+    // before the collapse and to the vertex normals. The latter stops triangles from turning a
+    // little further every round until they stand on their edge.
+    auto flips = [&](u32 from, u32 to) {
+        for (u32 a = adjacency_offsets[from]; a < adjacency_offsets[from + 1]; ++a) {
+            const u32* triangle = &result[adjacency[a] * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue;
+
+            glm::vec3 p[3], moved[3];
+            glm::vec3 vertex_normals(0.0f);
+            for (u32 c = 0; c < 3; ++c) {
+                u32 moved_index = triangle[c] == from ? to : triangle[c];
+                p[c] = vertices[triangle[c]].pos;
+                moved[c] = vertices[moved_index].pos;
+                vertex_normals += vertices[moved_index].normal;
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            f32 after_length = glm::length(after);
+            if (glm::dot(before, after) <= 1e-2f * glm::length(before) * after_length ||
+                glm::dot(vertex_normals, after) <=
+                    1e-2f * glm::length(vertex_normals) * after_length) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Every round collapses the cheapest edges whose neighbourhoods do not overlap, then the
+    // topology and costs are rebuilt.
+    u32 target_triangles = target_index_count / 3;
+    bool limit_cost = true;
+    while (result.size() / 3 > target_triangles) {
+        u32 num_triangles = result.size() / 3;
+        count_edges();
+
+        for (u32 v = 0; v < num_vertices; ++v) {
+            kinds[v] = wedges[position_of[v]] > 1 ? VertexKind::locked : VertexKind::interior;
+        }
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (u32 e = 0; e < 3; ++e) {
+                u32 a = result[i + e], b = result[i + (e + 1) % 3];
+                u32 count = edge_count(a, b);
+                for (u32 v : {a, b}) {
+                    if (count > 2) {
+                        kinds[v] = VertexKind::locked;
+                    } else if (count == 1 && kinds[v] == VertexKind::interior) {
+                        kinds[v] = VertexKind::border;
+                    }
+                }
+            }
+        }
+
+        build_adjacency();
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (u32 e = 0; e < 3; ++e) {
+                u32 a = result[i + e], b = result[i + (e + 1) % 3];
+                for (auto [from, to] : {std::pair{a, b}, std::pair{b, a}}) {
+                    // A locked target has several wedges and the one to use is unknown.
+                    if (kinds[from] == VertexKind::locked || kinds[to] == VertexKind::locked) {
+                        continue;
+                    }
+                    if (kinds[from] == VertexKind::border &&
+                        (kinds[to] != VertexKind::border || edge_count(from, to) != 1)) {
+                        continue;
+                    }
+                    Quadric quadric = quadrics[from];
+                    quadric.add(quadrics[to]);
+                    collapses.push_back({from, to, quadric.error(vertices[to].pos)});
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        // Every collapse removes about two triangles. Collapses well above the cost of the ones
+        // that would reach the target wait for the next round, where cheaper ones that were
+        // blocked by a neighbour can be done instead. Without any cheap ones left it is lifted.
+        u32 collapse_goal = (num_triangles - target_triangles) / 2;
+        double cost_limit = limit_cost && collapse_goal < collapses.size()
+                                ? collapses[collapse_goal].cost * 1.5
+                                : DBL_MAX;
+
+        std::iota(collapse_to.begin(), collapse_to.end(), 0);
+        std::fill(touched.begin(), touched.end(), 0);
+        u32 remaining = num_triangles;
+        u32 performed = 0;
+        for (const auto& collapse : collapses) {
+            if (remaining <= target_triangles || collapse.cost > cost_limit) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+            if (flips(collapse.from, collapse.to)) continue;
+
+            for (u32 a = adjacency_offsets[collapse.from]; a < adjacency_offsets[collapse.from + 1];
+                 ++a) {
+                const u32* triangle = &result[adjacency[a] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to ||
+                    triangle[2] == collapse.to) {
+                    remaining--;
+                }
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+            }
+            collapse_to[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            performed++;
+        }
+        if (performed == 0) {
+            if (!limit_cost) break;
+            limit_cost = false;
+            continue;
+        }
+        limit_cost = true;
+
+        for (u32 v = 0; v < num_vertices; ++v) {
+            representative[v] = collapse_to[representative[v]];
+        }
+
+        simplified.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            u32 a = collapse_to[result[i]];
+            u32 b = collapse_to[result[i + 1]];
+            u32 c = collapse_to[result[i + 2]];
+            if (position_of[a] == position_of[b] || position_of[b] == position_of[c] ||
+                position_of[c] == position_of[a]) {
+                continue;
+            }
+            simplified.insert(simplified.end(), {a, b, c});
+        }
+        std::swap(result, simplified);
+    }
+
+    // The quadric cost is a mean over the planes and underestimates how far the surface moved, so
+    // the error is measured instead: the distance from every removed vertex to the triangles
+    // around the vertices that it and its neighbours were collapsed into. The closest triangle may
+    // be elsewhere, which only makes the error conservative.
+    build_adjacency();
+    std::vector<f32> distances(num_vertices, 0.0f);
+    for (u32 v = 0; v < num_vertices; ++v) {
+        distances[v] = glm::length(vertices[v].pos - vertices[representative[v]].pos);
+    }
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (u32 c = 0; c < 3; ++c) {
+            u32 v = indices[i + c];
+            if (representative[v] == v) continue;
+
+            for (u32 neighbour = 0; neighbour < 3; ++neighbour) {
+                u32 kept = representative[indices[i + neighbour]];
+                for (u32 a = adjacency_offsets[kept]; a < adjacency_offsets[kept + 1]; ++a) {
+                    const u32* triangle = &result[adjacency[a] * 3];
+                    distances[v] = std::min(
+                        distances[v],
+                        distance_to_triangle(vertices[v].pos, vertices[triangle[0]].pos,
+                                             vertices[triangle[1]].pos, vertices[triangle[2]].pos));
+                }
+            }
+        }
+    }
+    for (f32 distance : distances) {
+        error = std::max(error, distance);
+    }
+    return result;
+}
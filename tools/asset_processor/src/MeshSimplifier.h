@@ -0,0 +1,22 @@
+#ifndef _MESH_SIMPLIFIER_H
+#define _MESH_SIMPLIFIER_H
+
+#include <span>
+#include <vector>
+
+#include "../../../src/engine/scene/Scene.h"
+
+using namespace engine;
+
+// Simplifies the mesh with edge collapses ordered by quadric error (Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics"). Vertices are only removed, never moved or
+// added, so the result indexes the same vertices and can share their buffer with the full mesh.
+//
+// Vertices with more than one set of attributes at their position (UV seams, hard edges) and
+// vertices on non-manifold edges are kept, border vertices only collapse along the border.
+// Stops at target_index_count indices or when no collapse is possible. error is set to an upper
+// bound of the object space distance from the vertices of the full mesh to the result.
+std::vector<u32> simplify_mesh(std::span<const u32> indices, std::span<const Vertex> vertices,
+                               u32 target_index_count, f32& error);
+
+#endif
@@ -1,17 +1,55 @@
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <json.hpp>
 #include <print>
 #include <unordered_map>
 
 #include "../../../src/engine/scene/Node.h"
+#include "../../../src/engine/utils/compression.h"
 #include "../../../src/engine/utils/logging.h"
 #include "AssetImporter.h"
 
+struct OutputSection {
+    AssetSection info;
+    // The bytes written to the file, the raw array or its compressed chunks.
+    std::span<const u8> stored;
+    std::vector<u8> compressed;
+};
+
 template <typename T>
-void write_data(std::vector<T>& data, std::ofstream& stream, u32& num_bytes_written) {
-    size_t size = sizeof(T) * data.size();
-    stream.write((const char*)data.data(), size);
-    num_bytes_written += size;
+static void add_section(std::vector<OutputSection>& sections, SectionType type,
+                        const std::vector<T>& data) {
+    std::span<const u8> raw((const u8*)data.data(), sizeof(T) * data.size());
+    OutputSection section = {};
+    section.info.type = type;
+    section.info.compression = SectionCompression::none;
+    section.info.uncompressed_size = raw.size();
+    section.stored = raw;
+
+    // Chunk sizes followed by the chunks, see CompressedSection in AssetLoader.h.
+    u64 num_chunks = (raw.size() + section_chunk_size - 1) / section_chunk_size;
+    std::vector<u8> compressed(num_chunks * sizeof(u32));
+    for (u64 chunk = 0; chunk < num_chunks; ++chunk) {
+        u64 begin = chunk * section_chunk_size;
+        auto src = raw.subspan(begin, std::min<u64>(section_chunk_size, raw.size() - begin));
+        u64 offset = compressed.size();
+        compressed.resize(offset + lz4_compress_bound(src.size()));
+        u32 chunk_size = lz4_compress(src, std::span(compressed).subspan(offset));
+        compressed.resize(offset + chunk_size);
+        std::memcpy(&compressed[chunk * sizeof(u32)], &chunk_size, sizeof(u32));
+    }
+
+    // Data that barely compresses, like block compressed images, is cheaper to read as it is.
+    if (compressed.size() < raw.size() / 8 * 7) {
+        section.compressed = std::move(compressed);
+        section.stored = section.compressed;
+        section.info.compression = SectionCompression::lz4;
+        section.info.chunk_size = section_chunk_size;
+    }
+    section.info.size = section.stored.size();
+    section.info.checksum = xxhash32(section.stored);
+    sections.push_back(std::move(section));
 }
 
 using json = nlohmann::json;
@@ -154,14 +192,34 @@ int main(int argc, const char** argv) {
         parse_prefabs(importer, engine_manifest, mesh_names_to_indices, manifest["prefabs"]);
     }
 
-    constexpr u32 curr_header_version = 2;
+    importer.pack_vertices();
+
+    constexpr u32 curr_header_version = 7;
+
+    std::vector<OutputSection> sections;
+    add_section(sections, SectionType::indices, importer.m_indices);
+    add_section(sections, SectionType::vertices, importer.m_packed_vertices);
+    add_section(sections, SectionType::meshes, importer.m_meshes);
+    add_section(sections, SectionType::primitives, importer.m_primitives);
+    add_section(sections, SectionType::meshlets, importer.m_meshlets);
+    add_section(sections, SectionType::prefab_nodes, importer.m_prefabs_nodes);
+    add_section(sections, SectionType::root_prefab_nodes, importer.m_root_prefab_nodes);
+    add_section(sections, SectionType::samplers, importer.m_samplers);
+    add_section(sections, SectionType::images, importer.m_images);
+    add_section(sections, SectionType::textures, importer.m_textures);
+    add_section(sections, SectionType::materials, importer.m_materials);
+    add_section(sections, SectionType::name_bytes, engine_manifest.m_name_bytes);
+    add_section(sections, SectionType::mesh_names, engine_manifest.m_mesh_names);
+    add_section(sections, SectionType::prefab_names, engine_manifest.m_prefab_names);
+    add_section(sections, SectionType::image_data, importer.m_image_data);
 
     AssetHeader header;
     header.version = curr_header_version;
     header.num_indices = importer.m_indices.size();
-    header.num_vertices = importer.m_vertices.size();
+    header.num_vertices = importer.m_packed_vertices.size();
     header.num_meshes = importer.m_meshes.size();
     header.num_primitives = importer.m_primitives.size();
+    header.num_meshlets = importer.m_meshlets.size();
     header.num_prefab_nodes = importer.m_prefabs_nodes.size();
     header.num_samplers = importer.m_samplers.size();
     header.num_images = importer.m_images.size();
@@ -169,28 +227,36 @@ int main(int argc, const char** argv) {
     header.num_materials = importer.m_materials.size();
     header.num_prefabs = engine_manifest.m_prefab_names.size();
     header.num_name_bytes = engine_manifest.m_name_bytes.size();
+    header.num_sections = sections.size();
     header.num_image_bytes = importer.m_image_data.size();
 
+    auto align = [](u64 offset) {
+        return (offset + section_alignment - 1) & ~(section_alignment - 1);
+    };
+    u64 offset = align(sizeof(AssetHeader) + sizeof(AssetSection) * sections.size());
+    for (auto& section : sections) {
+        section.info.offset = offset;
+        offset = align(offset + section.info.size);
+    }
+
     std::ofstream out_file("scene_data.bin", std::ios::binary);
 
-    // Write header.
+    // Write header and the section directory.
     out_file.write((const char*)&header, sizeof(AssetHeader));
-    u32 num_bytes_written = 0;
-    write_data(importer.m_indices, out_file, num_bytes_written);
-    write_data(importer.m_vertices, out_file, num_bytes_written);
-    write_data(importer.m_meshes, out_file, num_bytes_written);
-    write_data(importer.m_primitives, out_file, num_bytes_written);
-    write_data(importer.m_prefabs_nodes, out_file, num_bytes_written);
-    write_data(importer.m_root_prefab_nodes, out_file, num_bytes_written);
-    write_data(importer.m_samplers, out_file, num_bytes_written);
-    write_data(importer.m_images, out_file, num_bytes_written);
-    write_data(importer.m_textures, out_file, num_bytes_written);
-    write_data(importer.m_materials, out_file, num_bytes_written);
-    // write_data(engine_manifest.m_name_bytes, out_file, num_bytes_written);
-    // write_data(engine_manifest.m_mesh_names, out_file, num_bytes_written);
-    engine_manifest.serialize(out_file, num_bytes_written);
-    write_data(importer.m_image_data, out_file, num_bytes_written);
-    INFO("wrote {} bytes", num_bytes_written + sizeof(AssetHeader));
+    for (const auto& section : sections) {
+        out_file.write((const char*)&section.info, sizeof(AssetSection));
+    }
+    u64 num_bytes_written = sizeof(AssetHeader) + sizeof(AssetSection) * sections.size();
+    const char padding[section_alignment] = {};
+    for (const auto& section : sections) {
+        out_file.write(padding, section.info.offset - num_bytes_written);
+        out_file.write((const char*)section.stored.data(), section.stored.size());
+        num_bytes_written = section.info.offset + section.info.size;
+        INFO("{}: {} bytes, stored {} bytes{}", section_type_name(section.info.type),
+             section.info.uncompressed_size, section.info.size,
+             section.info.compression == SectionCompression::lz4 ? " compressed" : "");
+    }
+    INFO("wrote {} bytes", num_bytes_written);
 
     out_file.flush();
     out_file.close();